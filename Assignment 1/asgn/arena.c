@@ -0,0 +1,115 @@
+/*
+ * Implementation of arena.h
+ *
+ * Memory is handed out by bumping a pointer through large blocks, so
+ * things allocated one after another sit next to each other. Nothing
+ * is freed on its own; arena_free releases every block at once.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "mylib.h"
+
+#define BLOCK_SIZE 65536
+#define ALIGNMENT sizeof(void *)
+
+/*
+ * A block of memory, chained to the blocks that were filled before it.
+ */
+
+struct arena_block {
+    struct arena_block *next;
+    size_t size;
+    size_t used;
+    char *data;
+};
+
+struct arenarec {
+    struct arena_block *head;
+};
+
+/*
+ * Creates a new arena with no blocks.
+ * @return the empty arena
+ */
+
+arena arena_new(void) {
+    arena a = emalloc(sizeof *a);
+    a->head = NULL;
+    return a;
+}
+
+/*
+ * Allocates a block with room for at least size bytes and puts it at
+ * the front of the arena.
+ * @param a the arena to add to
+ * @param size number of bytes that must fit in the block
+ */
+
+static void arena_add_block(arena a, size_t size) {
+    struct arena_block *b = emalloc(sizeof *b);
+    b->size = size > BLOCK_SIZE ? size : BLOCK_SIZE;
+    b->used = 0;
+    b->data = emalloc(b->size);
+    b->next = a->head;
+    a->head = b;
+}
+
+/*
+ * Allocates size bytes from the arena, aligned for any pointer.
+ * @param a the arena to allocate from
+ * @param size number of bytes wanted
+ * @return pointer to the memory, valid until arena_free
+ */
+
+void *arena_alloc(arena a, size_t size) {
+    size_t start;
+
+    if (a->head != NULL) {
+        start = (a->head->used + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+        if (start + size <= a->head->size) {
+            a->head->used = start + size;
+            return a->head->data + start;
+        }
+    }
+    arena_add_block(a, size);
+    a->head->used = size;
+    return a->head->data;
+}
+
+/*
+ * Copies a string into the arena. Strings are not padded, so strings
+ * copied one after another are packed together.
+ * @param a the arena to copy into
+ * @param str the string to copy
+ * @return the copy
+ */
+
+char *arena_strdup(arena a, char *str) {
+    size_t len = strlen(str) + 1;
+    char *copy;
+
+    if (a->head == NULL || a->head->used + len > a->head->size) {
+        arena_add_block(a, len);
+    }
+    copy = a->head->data + a->head->used;
+    a->head->used += len;
+    return memcpy(copy, str, len);
+}
+
+/*
+ * Frees every block in the arena, and the arena itself.
+ * @param a the arena to free
+ */
+
+void arena_free(arena a) {
+    struct arena_block *b, *next;
+    for (b = a->head; b != NULL; b = next) {
+        next = b->next;
+        free(b->data);
+        free(b);
+    }
+    free(a);
+}
@@ -10,11 +10,30 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <getopt.h>
+#include <pthread.h>
 #include "htable.h"
+#include "sketch.h"
 #include "mylib.h"
 
 #define SIZE 113
+#define THREAD_LOAD 70
+#define BATCH 64
+#define APPROX_DELTA 0.01
+#define APPROX_WORDS 10
+
+/*
+ * A piece of the input for one thread to count, and the table it
+ * counts the words into.
+ */
+
+struct chunk {
+    char *start;
+    char *end;
+    htable h;
+    pthread_t thread;
+};
 
 /*
  * Determines if passed number is prime.
@@ -26,7 +45,7 @@
 
 static int is_prime(int num) {
     int i = 2;
-    for(i =2; i < num; i++) {
+    for(i =2; i * i <= num; i++) {
         if(num % i == 0) {
             return 0;
         }
@@ -48,10 +67,23 @@ int get_next_prime(int size) {
     if (n < 2) {
         return 2;
     }
-    else{
-        if(is_prime(n) == 0) {
-            return get_next_prime(n+1);
-        }
+    while (is_prime(n) == 0) {
+        n++;
+    }
+    return n;
+}
+
+/*
+ * Finds the next power of two greater or equal to given size.
+ *
+ * @param size The minimum size for hashtable.
+ *
+ * @return the next power of two that is greater or equal.
+ */
+static int get_next_power_of_two(int size) {
+    int n = 2;
+    while (n < size) {
+        n *= 2;
     }
     return n;
 }
@@ -66,6 +98,188 @@ static void print_info(int freq, char *word) {
     printf("%-4d %s\n", freq, word);
 }
 
+/*
+ * Reads everything that is left in a stream into memory.
+ * @param stream the stream to read
+ * @param len set to the number of characters read
+ * @return the characters read, which the caller must free
+ */
+
+static char *read_all(FILE *stream, size_t *len) {
+    size_t size = 65536;
+    char *buf = emalloc(size);
+
+    *len = 0;
+    while (!feof(stream) && !ferror(stream)) {
+        if (*len == size) {
+            size *= 2;
+            buf = erealloc(buf, size);
+        }
+        *len += fread(buf + *len, 1, size - *len, stream);
+    }
+    return buf;
+}
+
+/*
+ * Counts the words in one chunk of the input, BATCH words at a time.
+ * Run by each thread.
+ * @param arg the chunk to count
+ * @return NULL
+ */
+
+static void *count_chunk(void *arg) {
+    struct chunk *c = arg;
+    char words[BATCH][256];
+    char *batch[BATCH];
+    int n = 0;
+
+    while (getword_buf(words[n], sizeof words[n], &c->start, c->end) != EOF) {
+        batch[n] = words[n];
+        if (++n == BATCH) {
+            htable_insert_batch(c->h, batch, n);
+            n = 0;
+        }
+    }
+    htable_insert_batch(c->h, batch, n);
+    return NULL;
+}
+
+/*
+ * Counts the words in a stream, BATCH words at a time.
+ * @param h hashtable to count the words into
+ * @param stream the stream to read
+ */
+
+static void count_stream(htable h, FILE *stream) {
+    char words[BATCH][256];
+    char *batch[BATCH];
+    int n = 0;
+
+    while (getword(words[n], sizeof words[n], stream) != EOF) {
+        batch[n] = words[n];
+        if (++n == BATCH) {
+            htable_insert_batch(h, batch, n);
+            n = 0;
+        }
+    }
+    htable_insert_batch(h, batch, n);
+}
+
+/*
+ * Searches the table for every word in a stream, BATCH words at a
+ * time, and prints each word that is not there.
+ * @param h hashtable to search
+ * @param stream the stream of words to check
+ * @return number of words that were not found
+ */
+
+static int check_stream(htable h, FILE *stream) {
+    char words[BATCH][256];
+    char *batch[BATCH];
+    int freqs[BATCH];
+    int n = 0, i, unknown = 0;
+
+    for (;;) {
+        while (n < BATCH && getword(words[n], sizeof words[n], stream) != EOF) {
+            batch[n] = words[n];
+            n++;
+        }
+        if (n == 0) {
+            return unknown;
+        }
+        htable_search_batch(h, batch, n, freqs);
+        for (i = 0; i < n; i++) {
+            if (freqs[i] == 0) {
+                printf("%s\n", batch[i]);
+                unknown++;
+            }
+        }
+        n = 0;
+    }
+}
+
+/*
+ * Counts the words on stdin using several threads. The input is split
+ * into chunks that each start just after a character that cannot be
+ * part of a word, so every chunk holds the same words getword would
+ * have read. Each thread counts its chunk into a table of its own,
+ * and the tables are then merged into h in input order.
+ * @param h hashtable to count the words into
+ * @param num_threads how many threads to use
+ * @param method collision resolution for the thread tables
+ * @param hash_fn hash function for the thread tables
+ * @param table_size starting size of the thread tables
+ * @param max_load load, as a percentage, at which thread tables grow
+ */
+
+static void count_parallel(htable h, int num_threads, hashing_t method,
+                           hash_fn_t hash_fn, int table_size, int max_load) {
+    struct chunk *chunks = emalloc(num_threads * sizeof chunks[0]);
+    size_t len, pos;
+    char *buf = read_all(stdin, &len);
+    int i;
+
+    for (i = 0; i < num_threads; i++) {
+        pos = len / num_threads * i;
+        while (pos > 0 && pos < len
+               && (isalnum((unsigned char) buf[pos - 1]) || buf[pos - 1] == '\'')) {
+            pos++;
+        }
+        chunks[i].start = buf + pos;
+        if (i > 0) {
+            chunks[i - 1].end = chunks[i].start;
+        }
+    }
+    chunks[num_threads - 1].end = buf + len;
+
+    for (i = 0; i < num_threads; i++) {
+        /* words must never be dropped by a thread table that fills up */
+        chunks[i].h = htable_new_hash(table_size, method, hash_fn);
+        htable_set_max_load(chunks[i].h,
+                            (max_load > 0 ? max_load : THREAD_LOAD) / 100.0);
+        if (pthread_create(&chunks[i].thread, NULL, count_chunk, &chunks[i]) != 0) {
+            fprintf(stderr, "Could not create thread %d\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (i = 0; i < num_threads; i++) {
+        pthread_join(chunks[i].thread, NULL);
+        htable_merge(h, chunks[i].h);
+        htable_free(chunks[i].h);
+    }
+    free(chunks);
+    free(buf);
+}
+
+/*
+ * Counts the words in a stream approximately, in memory that does not
+ * grow with the number of different words, then prints the words that
+ * look most frequent with their estimated frequencies.
+ * @param stream the stream to read
+ * @param epsilon how far off an estimate may be, as a fraction of the
+ * number of words
+ * @param delta chance of an estimate being further off than that
+ * @param num_words how many of the most frequent words to print
+ * @param stats nonzero to print the size and bounds of the sketch
+ * instead of the words
+ */
+
+static void count_approx(FILE *stream, double epsilon, double delta, int num_words,
+                         int stats) {
+    sketch s = sketch_new(epsilon, delta);
+    char word[256];
+
+    while (getword(word, sizeof word, stream) != EOF) {
+        sketch_insert(s, word);
+    }
+    if (stats) {
+        sketch_print_stats(s, stdout);
+    } else {
+        sketch_top(s, num_words, print_info);
+    }
+    sketch_free(s);
+}
+
 /*
  * Prints a message explaining how to use the program.
  */
@@ -76,11 +290,35 @@ static void print_help(){
  Perform various operations using a hash table.  By default, words are\n \
  read from stdin and added to the hash table, before being printed out\n\
  alongside their frequencies to stdout.\n\n");
+    printf(" -2           Round TABLESIZE up to a power of two instead of a prime\n");
+    printf(" -a EPSILON   Count approximately in fixed memory, with estimates at\n\
+              most EPSILON times the number of words too high, and\n\
+              print the K (see -k, default 10) most frequent words\n");
+    printf(" -b           Put a Bloom filter in front of the table for searches\n");
+    printf(" -c FILENAME  Print the words in FILENAME that are not in the table\n");
     printf(" -d           Use double hashing (linear probing is the default)\n");
     printf(" -e           Display entire contents of hash table on stderr\n");
+    printf(" -f HASH      Hash words with HASH: word (the default), fnv for\n\
+              64-bit FNV-1a, or wide for a hash that reads 8 bytes\n\
+              at a time\n");
+    printf(" -g           Use Swiss table style group probing on hash tags\n");
+    printf(" -i FILE      Use the table saved in FILE instead of reading stdin\n");
+    printf(" -j THREADS   Count the words with THREADS threads, then merge;\n\
+              the table grows as if -l %d were given, unless -l is\n", THREAD_LOAD);
+    printf("              given too\n");
+    printf(" -k K         Print only the K most frequent words, most frequent first\n");
+    printf(" -l LOAD      Grow the table once it is more than LOAD percent full\n");
+    printf(" -m FILE      Write machine-readable stats as JSON to FILE\n");
+    printf(" -n           Use linear probing with short words kept in the slots\n");
+    printf(" -o FILE      Save the table to FILE for later use with -i\n");
     printf(" -p           Print stats info instead of frequencies & words\n");
+    printf(" -r           Use Robin Hood hashing\n");
     printf(" -s SNAPSHOTS Show SNAPSHOTS stats snapshots (if -p is used)\n");
-    printf(" -t TABLESIZE Use the first prime >= TABLESIZE as htable size\n\n");
+    printf(" -t TABLESIZE Use the first prime >= TABLESIZE as htable size\n");
+    printf(" -u           Use cuckoo hashing with buckets of 4 slots\n");
+    printf(" -x DELTA     Chance of an -a estimate being further off (default 0.01)\n");
+    printf(" -z           Freeze the table into a minimal perfect hash once the\n\
+              words are counted\n\n");
     printf(" -h           Display this message\n\n");
 }
 
@@ -93,34 +331,102 @@ static void print_help(){
 
 int main(int argc, char** argv) {
     htable default_hash;
-    char word[256];
-    hashing_t hashing_method;
+    hashing_t hashing_method = LINEAR_P;
+    hash_fn_t hash_fn = WORD_F;
     
-    int d_arg = 0, e_arg = 0, p_arg = 0, s_arg = 0;
+    int b_arg = 0, e_arg = 0, p_arg = 0, s_arg = 0, z_arg = 0, two_arg = 0;
     int table_size = SIZE;
     int snapshots = 0; 
+    int max_load = 0;
+    int num_threads = 1;
+    int top_k = 0;
+    int unknown;
+    double epsilon = 0.0, delta = APPROX_DELTA;
+    char *load_file = NULL, *save_file = NULL, *json_file = NULL;
+    char *check_file = NULL;
+    FILE *snapshot, *json, *check;
 
 
-    const char *optstring = "deps:t:h";
+    const char *optstring = "2a:bc:def:gi:j:k:l:m:no:prs:t:ux:zh";
     char option;
     
     while ((option = getopt(argc, argv, optstring)) != EOF) {
         switch (option) {
+            case '2':
+                two_arg = 1;
+                break;
+            case 'a':
+                epsilon = atof(optarg);
+                break;
+            case 'b':
+                b_arg = 1;
+                break;
+            case 'c':
+                check_file = optarg;
+                break;
             case 'd':
-                d_arg = 1;
+                hashing_method = DOUBLE_H;
                 break;
             case 'e':
                 e_arg = 1;
                 break;
+            case 'f':
+                if (strcmp(optarg, "fnv") == 0) {
+                    hash_fn = FNV1A_F;
+                } else if (strcmp(optarg, "wide") == 0) {
+                    hash_fn = WIDE_F;
+                } else if (strcmp(optarg, "word") == 0) {
+                    hash_fn = WORD_F;
+                } else {
+                    print_help();
+                    return 1;
+                }
+                break;
+            case 'g':
+                hashing_method = SWISS_P;
+                break;
+            case 'i':
+                load_file = optarg;
+                break;
+            case 'j':
+                num_threads = atoi(optarg);
+                break;
+            case 'k':
+                top_k = atoi(optarg);
+                break;
+            case 'l':
+                max_load = atoi(optarg);
+                break;
+            case 'm':
+                json_file = optarg;
+                break;
+            case 'n':
+                hashing_method = INLINE_P;
+                break;
+            case 'o':
+                save_file = optarg;
+                break;
             case 'p':
                 p_arg = 1;
                 break;
+            case 'r':
+                hashing_method = ROBIN_H;
+                break;
             case 's':
                 s_arg = 1;
                 snapshots = atoi(optarg);
                 break;
             case 't':
-                table_size = get_next_prime(atoi(optarg));
+                table_size = atoi(optarg);
+                break;
+            case 'u':
+                hashing_method = CUCKOO_H;
+                break;
+            case 'x':
+                delta = atof(optarg);
+                break;
+            case 'z':
+                z_arg = 1;
                 break;
             case 'h':
                 print_help();
@@ -131,20 +437,72 @@ int main(int argc, char** argv) {
         }
     }
 
-    
-    if (d_arg == 1) {
-        hashing_method = DOUBLE_H;
-        default_hash = htable_new(table_size, hashing_method);
+    if (epsilon > 0.0) {
+        count_approx(stdin, epsilon, delta, top_k > 0 ? top_k : APPROX_WORDS, p_arg);
+        return EXIT_SUCCESS;
     }
-    
-    if(d_arg == 0) {
-        hashing_method = LINEAR_P;
-        default_hash = htable_new(table_size, hashing_method);
+
+    /* a power of two size lets the table find slots without dividing */
+    table_size = two_arg ? get_next_power_of_two(table_size) : get_next_prime(table_size);
+
+    if (load_file != NULL) {
+        if ((default_hash = htable_open_mapped(load_file)) == NULL) {
+            fprintf(stderr, "Could not open snapshot '%s'\n", load_file);
+            return EXIT_FAILURE;
+        }
+    } else {
+        default_hash = htable_new_hash(table_size, hashing_method, hash_fn);
+    }
+    /*
+     * A full table drops words in the order they arrive, which is not
+     * the same when counting on threads, so that table must grow.
+     */
+    if (max_load <= 0 && num_threads > 1 && load_file == NULL) {
+        max_load = THREAD_LOAD;
+    }
+    if (max_load > 0) {
+        htable_set_max_load(default_hash, max_load / 100.0);
+    }
+    if (load_file != NULL) {
+        /* the words were counted when the snapshot was saved */
+    } else if (num_threads > 1) {
+        count_parallel(default_hash, num_threads, hashing_method, hash_fn,
+                       table_size, max_load);
+    } else {
+        count_stream(default_hash, stdin);
     }
-    while(getword(word, sizeof word, stdin) != EOF) {
-        htable_insert(default_hash, word);
+    if (z_arg == 1 && !htable_freeze(default_hash)) {
+        fprintf(stderr, "Could not freeze the table\n");
+        return EXIT_FAILURE;
+    }
+    if (b_arg == 1) {
+        htable_use_filter(default_hash);
+    }
+    if (check_file != NULL) {
+        if ((check = fopen(check_file, "r")) == NULL) {
+            fprintf(stderr, "Could not open '%s'\n", check_file);
+            return EXIT_FAILURE;
+        }
+        unknown = check_stream(default_hash, check);
+        fclose(check);
+        fprintf(stderr, "Unknown words = %d\n", unknown);
     }
     
+    if (save_file != NULL) {
+        if ((snapshot = fopen(save_file, "wb")) == NULL
+            || !htable_save(default_hash, snapshot) || fclose(snapshot) != 0) {
+            fprintf(stderr, "Could not save snapshot '%s'\n", save_file);
+            return EXIT_FAILURE;
+        }
+    }
+    if (json_file != NULL) {
+        if ((json = fopen(json_file, "w")) == NULL) {
+            fprintf(stderr, "Could not open '%s'\n", json_file);
+            return EXIT_FAILURE;
+        }
+        htable_print_stats_json(default_hash, json);
+        fclose(json);
+    }
     if (e_arg == 1) { 
         htable_print_entire_table(default_hash, stderr);
         htable_print(default_hash, print_info);
@@ -155,6 +513,12 @@ int main(int argc, char** argv) {
     else if (p_arg == 1) {
         htable_print_stats(default_hash, stdout, 10);
     }
+    else if (check_file != NULL) {
+        /* the unknown words have been printed already */
+    }
+    else if (top_k > 0) {
+        htable_top_k(default_hash, top_k, print_info);
+    }
     else {
         htable_print(default_hash, print_info);
     }
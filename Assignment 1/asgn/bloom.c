@@ -0,0 +1,116 @@
+/*
+ * Implementation of bloom.h
+ *
+ * A blocked Bloom filter. The filter is an array of 64-byte blocks,
+ * each one cache line, and all the bits for a key are set in the
+ * same block. Checking a key therefore costs at most one cache miss,
+ * however many bits are set per key.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "bloom.h"
+#include "mylib.h"
+
+#define BLOCK_BYTES 64
+#define BLOCK_WORDS (BLOCK_BYTES / sizeof(uint64_t))
+#define BITS_PER_KEY 16
+#define BITS_SET 8
+
+struct bloomrec {
+    uint64_t *blocks;
+    void *memory;
+    uint64_t num_blocks;
+};
+
+/*
+ * Creates an empty filter with room for num_keys keys at
+ * BITS_PER_KEY bits each.
+ * @param num_keys number of keys the filter is sized for
+ * @return the empty filter
+ */
+
+bloom bloom_new(int num_keys) {
+    bloom b = emalloc(sizeof *b);
+    size_t bytes;
+
+    b->num_blocks = ((uint64_t) num_keys * BITS_PER_KEY + BLOCK_BYTES * 8 - 1)
+        / (BLOCK_BYTES * 8);
+    if (b->num_blocks == 0) {
+        b->num_blocks = 1;
+    }
+    bytes = b->num_blocks * BLOCK_BYTES;
+    /* line the blocks up with cache lines */
+    b->memory = emalloc(bytes + BLOCK_BYTES - 1);
+    b->blocks = (uint64_t *) (((uintptr_t) b->memory + BLOCK_BYTES - 1)
+                              & ~(uintptr_t) (BLOCK_BYTES - 1));
+    memset(b->blocks, 0, bytes);
+    return b;
+}
+
+/*
+ * Spreads the bits of a hash out so that every output bit depends on
+ * every input bit, as the callers' hashes may be weak in some bits.
+ * @param x the hash
+ * @return the mixed hash
+ */
+
+static uint64_t bloom_mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= UINT64_C(0xff51afd7ed558ccd);
+    x ^= x >> 33;
+    x *= UINT64_C(0xc4ceb9fe1a85ec53);
+    x ^= x >> 33;
+    return x;
+}
+
+/*
+ * Adds a key to the filter.
+ * @param b the filter
+ * @param hash 64-bit hash of the key
+ */
+
+void bloom_add(bloom b, uint64_t hash) {
+    uint64_t x = bloom_mix(hash);
+    uint64_t *block = b->blocks + (x >> 32) % b->num_blocks * BLOCK_WORDS;
+    uint32_t bit = (uint32_t) x, step = (uint32_t) (x >> 23) | 1;
+    int i;
+
+    for (i = 0; i < BITS_SET; i++, bit += step) {
+        block[(bit >> 6) % BLOCK_WORDS] |= UINT64_C(1) << (bit & 63);
+    }
+}
+
+/*
+ * Checks whether a key may have been added to the filter.
+ * @param b the filter
+ * @param hash 64-bit hash of the key
+ * @return 0 if the key was definitely never added, or 1 if it may
+ * have been
+ */
+
+int bloom_maybe(bloom b, uint64_t hash) {
+    uint64_t x = bloom_mix(hash);
+    uint64_t *block = b->blocks + (x >> 32) % b->num_blocks * BLOCK_WORDS;
+    uint32_t bit = (uint32_t) x, step = (uint32_t) (x >> 23) | 1;
+    int i;
+
+    for (i = 0; i < BITS_SET; i++, bit += step) {
+        if ((block[(bit >> 6) % BLOCK_WORDS] & UINT64_C(1) << (bit & 63)) == 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Frees the filter.
+ * @param b the filter to free
+ */
+
+void bloom_free(bloom b) {
+    free(b->memory);
+    free(b);
+}
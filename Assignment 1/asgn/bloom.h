@@ -0,0 +1,13 @@
+#ifndef BLOOM_H_
+#define BLOOM_H_
+
+#include <stdint.h>
+
+typedef struct bloomrec *bloom;
+
+extern bloom  bloom_new(int num_keys);
+extern void   bloom_add(bloom b, uint64_t hash);
+extern int    bloom_maybe(bloom b, uint64_t hash);
+extern void   bloom_free(bloom b);
+
+#endif
@@ -0,0 +1,171 @@
+/*
+ * Implementation of chtable.h
+ *
+ * A linear probing hashtable that many threads can insert into and
+ * search at the same time without locks. A thread claims an empty
+ * slot by swapping its copy of the key in with compare-and-swap, and
+ * frequencies are bumped with atomic adds. Keys are never moved or
+ * removed, so once a slot holds a key it holds it for good and a
+ * search can follow a probe sequence while other threads extend it.
+ * The capacity is fixed, as growing would mean moving keys.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "chtable.h"
+#include "mylib.h"
+
+struct chtablerec {
+    char **keys;
+    int *freqs;
+    int capacity;
+    int num_keys;
+};
+
+/*
+ * Creates and initialises a new, empty concurrent hashtable. This is
+ * the only function that must not race with the others.
+ * @param capacity size of new hashtable
+ * @return h returns initialised but empty hashtable
+ */
+
+chtable chtable_new(int capacity) {
+    int i;
+
+    chtable h = emalloc(sizeof *h);
+    h->capacity = capacity;
+    h->num_keys = 0;
+    h->freqs = emalloc(h->capacity * sizeof h->freqs[0]);
+    h->keys = emalloc(h->capacity * sizeof h->keys[0]);
+    for (i = 0; i < h->capacity; i++) {
+        h->freqs[i] = 0;
+        h->keys[i] = NULL;
+    }
+    return h;
+}
+
+/*
+ * Frees the hashtable. Every other thread must be finished with it.
+ * @param h hashtable that we wish to free
+ */
+
+void chtable_free(chtable h) {
+    int i;
+    for (i = 0; i < h->capacity; i++) {
+        free(h->keys[i]);
+    }
+    free(h->freqs);
+    free(h->keys);
+    free(h);
+}
+
+/*
+ * Home slot of a word, from its 64-bit FNV-1a hash.
+ * @param h hashtable
+ * @param word word to hash
+ * @return index of the home slot
+ */
+
+static unsigned int chtable_home(chtable h, char *word) {
+    uint64_t result = UINT64_C(14695981039346656037);
+    while (*word != '\0') {
+        result ^= (unsigned char) *word++;
+        result *= UINT64_C(1099511628211);
+    }
+    return (unsigned int) (result % h->capacity);
+}
+
+/*
+ * Inserts a word into the hashtable or increases its frequency if it
+ * is already there. Safe to call from many threads at once.
+ * @param h hashtable we are inserting into
+ * @param str the word we are inserting
+ * @return frequency of the word after this insert, or 0 if the table
+ * is full
+ */
+
+int chtable_insert(chtable h, char *str) {
+    unsigned int index = chtable_home(h, str);
+    char *mine = NULL;
+    char *key;
+    int coll;
+
+    for (coll = 0; coll < h->capacity; coll++) {
+        key = __atomic_load_n(&h->keys[index], __ATOMIC_ACQUIRE);
+        if (key == NULL) {
+            if (mine == NULL) {
+                mine = strcpy(emalloc((strlen(str) + 1) * sizeof str[0]), str);
+            }
+            /* on failure key is set to whatever another thread put here */
+            if (__atomic_compare_exchange_n(&h->keys[index], &key, mine, 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                __atomic_add_fetch(&h->num_keys, 1, __ATOMIC_RELAXED);
+                return __atomic_add_fetch(&h->freqs[index], 1, __ATOMIC_RELAXED);
+            }
+        }
+        if (strcmp(key, str) == 0) {
+            free(mine);
+            return __atomic_add_fetch(&h->freqs[index], 1, __ATOMIC_RELAXED);
+        }
+        index = (index + 1) % h->capacity;
+    }
+    free(mine);
+    return 0;
+}
+
+/*
+ * Searches the hashtable for a given word. Safe to call while other
+ * threads insert; an insert that has claimed a slot but not yet
+ * counted the word may not be seen.
+ * @param h hashtable to search
+ * @param str word to look for
+ * @return frequency of str in hashtable
+ */
+
+int chtable_search(chtable h, char *str) {
+    unsigned int index = chtable_home(h, str);
+    char *key;
+    int coll;
+
+    for (coll = 0; coll < h->capacity; coll++) {
+        key = __atomic_load_n(&h->keys[index], __ATOMIC_ACQUIRE);
+        if (key == NULL) {
+            return 0;
+        }
+        if (strcmp(key, str) == 0) {
+            return __atomic_load_n(&h->freqs[index], __ATOMIC_RELAXED);
+        }
+        index = (index + 1) % h->capacity;
+    }
+    return 0;
+}
+
+/*
+ * Number of different words in the hashtable.
+ * @param h hashtable to count the words of
+ * @return number of keys
+ */
+
+int chtable_num_keys(chtable h) {
+    return __atomic_load_n(&h->num_keys, __ATOMIC_RELAXED);
+}
+
+/*
+ * prints the frequency and keys in the hashtable. Inserts running at
+ * the same time may or may not be included.
+ * @param h hashtable we want to print
+ * @param p function to call with each frequency and word
+ */
+
+void chtable_print(chtable h, void p(int freq, char *word)) {
+    char *key;
+    int i;
+    for (i = 0; i < h->capacity; i++) {
+        key = __atomic_load_n(&h->keys[i], __ATOMIC_ACQUIRE);
+        if (key != NULL) {
+            p(__atomic_load_n(&h->freqs[i], __ATOMIC_RELAXED), key);
+        }
+    }
+}
@@ -0,0 +1,15 @@
+#ifndef CHTABLE_H_
+#define CHTABLE_H_
+
+#include <stdio.h>
+
+typedef struct chtablerec *chtable;
+
+extern void    chtable_free(chtable h);
+extern int     chtable_insert(chtable h, char *str);
+extern chtable chtable_new(int capacity);
+extern void    chtable_print(chtable h, void p(int freq, char *key));
+extern int     chtable_search(chtable h, char *str);
+extern int     chtable_num_keys(chtable h);
+
+#endif
@@ -2,12 +2,175 @@
  * Implementation of htable.h
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "arena.h"
+#include "bloom.h"
 #include "htable.h"
 #include "mylib.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+ * SWISS_P keeps one tag byte per slot and compares a group of them at
+ * a time. A tag is either EMPTY_TAG or seven bits of the hash.
+ */
+
+#define GROUP_SIZE 16
+#define EMPTY_TAG 0x80
+#define DELETED_TAG 0xfe
+
+/*
+ * DOUBLE_H and SWISS_P mark removed words with a tombstone: an empty
+ * key whose frequency is DELETED, which probing carries on past.
+ */
+
+#define DELETED -1
+
+/*
+ * The batch functions hash BATCH_SIZE words before probing for any of
+ * them, so the cache misses of the whole batch overlap.
+ */
+
+#define BATCH_SIZE 16
+
+/*
+ * CUCKOO_H splits the table into buckets of BUCKET_SLOTS slots
+ * followed by a stash of STASH_SIZE slots. A word lives in one of its
+ * two buckets or in the stash, so a search reads at most two buckets.
+ * An insert that finds both buckets full moves a word out of the way
+ * to its other bucket, and so on for at most MAX_KICKS moves before
+ * the word left over goes into the stash.
+ */
+
+#define BUCKET_SLOTS 4
+#define STASH_SIZE 8
+#define MAX_KICKS 64
+
+/*
+ * htable_freeze builds a CHD minimal perfect hash: the words are put
+ * in buckets of about FREEZE_LAMBDA words each, and every bucket gets
+ * the first displacement that sends all of its words to free slots.
+ * Buckets are placed biggest first. There are num_keys / FREEZE_ALPHA
+ * slots to place them in, as the last buckets would need about as many
+ * tries as there are slots to find the only free ones if there were
+ * exactly num_keys. The slots are then ranked so that only the used
+ * ones take up room. If some bucket has no displacement below
+ * FREEZE_MAX_DISP the build starts again with a new seed, up to
+ * FREEZE_SEEDS times.
+ */
+
+#define FREEZE_LAMBDA 4
+#define FREEZE_ALPHA 0.9
+#define FREEZE_MAX_DISP (1u << 22)
+#define FREEZE_SEEDS 8
+
+/*
+ * Which of 64 slots of a frozen table hold a word, and how many words
+ * are in the slots before them. A word in slot i is at index
+ * ranks[i / 64].rank plus the number of used slots below it in
+ * ranks[i / 64].used.
+ */
+
+struct rank_word {
+    uint64_t used;
+    uint32_t rank;
+};
+
+/*
+ * INLINE_P probes linearly over slots that hold the word, its length
+ * and its frequency together, two slots to a cache line. Words shorter
+ * than INLINE_KEY are kept in the slot itself. Longer ones keep their
+ * first INLINE_KEY bytes there, to compare against before following
+ * the pointer to the whole word in h->strings. An empty slot has a
+ * frequency of 0.
+ */
+
+#define INLINE_KEY 16
+
+struct inline_slot {
+    char key[INLINE_KEY];
+    int freq;
+    int len;
+    char *spill;
+};
+
+/*
+ * A snapshot written by htable_save is a snapshot_header followed by
+ * capacity key offsets, capacity frequencies, capacity stats and then
+ * the string pool the offsets point into. Offsets are one more than
+ * the position of the key in the pool, so 0 can mean an empty slot.
+ * Everything is in the byte order of the machine that wrote it.
+ */
+
+#define SNAPSHOT_MAGIC "HTABLE1"
+#define SNAPSHOT_EMPTY 0
+#define SNAPSHOT_DELETED UINT32_MAX
+
+struct snapshot_header {
+    char magic[8];
+    int capacity;
+    int num_keys;
+    int method;
+    int hash_fn;
+    int max_dist;
+    int tombstones;
+    uint32_t pool_size;
+    uint32_t unused;
+};
+
+/*
+ * Unless HTABLE_NO_INSTRUMENT is defined, every insert and search is
+ * counted: how many slots it probed and how many times it called
+ * strcmp. Reading the clock costs more than a short probe, so only one
+ * operation in CLOCK_SAMPLE is timed. Probe lengths go in histograms
+ * whose bucket b holds lengths from 2^b up to 2^(b+1) - 1. The load
+ * factor is sampled every so many inserts, keeping at most
+ * LOAD_SAMPLES samples by dropping every second one and sampling half
+ * as often once full.
+ */
+
+#define HIST_BUCKETS 32
+#define LOAD_SAMPLES 64
+#define CLOCK_SAMPLE 64
+
+enum htable_op { OP_INSERT, OP_HIT, OP_MISS, NUM_OPS };
+
+struct htable_counters {
+    long probes[NUM_OPS][HIST_BUCKETS];
+    long ops[NUM_OPS];
+    long strcmps;
+    long op_strcmps[NUM_OPS];
+    uint64_t op_clock[NUM_OPS];
+    long timed[NUM_OPS];
+    int until_clock;
+    long sample_every;
+    long until_sample;
+    int num_samples;
+    long sample_ops[LOAD_SAMPLES];
+    double sample_load[LOAD_SAMPLES];
+};
+
+#ifdef __GNUC__
+#define PREFETCH(p) __builtin_prefetch(p)
+#else
+#define PREFETCH(p) ((void) (p))
+#endif
+
 /*
  * Initialising members that make
  * the hashtable struct
@@ -15,13 +178,124 @@
 
 struct htablerec {
     char** keys;
+    struct inline_slot *slots;
+    arena strings;
     int* freqs;
     int num_keys;
     int capacity;
+    unsigned int mask;
+    int shift;
     int *stats;
+    unsigned char *tags;
+    int *dists;
+    int max_dist;
+    int tombstones;
+    int stash_used;
+    long kicks;
+    double stash_load;
+    uint32_t *disp;
+    int num_buckets;
+    int num_slots;
+    struct rank_word *ranks;
+    uint64_t seed;
+    char *pool;
+    uint32_t *offsets;
+    void *map;
+    size_t map_size;
+    struct htable_counters *counters;
+    bloom filter;
+    long filter_rejects;
+    long filter_false;
     hashing_t method;
+    hash_fn_t hash_fn;
+    double max_load;
+    int rehash_step;
+    int rehash_pos;
+    htable old;
 };
 
+/*
+ * Returns the first prime that is greater than or equal to n.
+ * @param n lower bound for the prime
+ * @return the next prime
+ */
+
+static int htable_next_prime(int n) {
+    int i;
+    if (n < 2) {
+        return 2;
+    }
+    for (;; n++) {
+        for (i = 2; i * i <= n && n % i != 0; i++)
+            ;
+        if (i * i > n) {
+            return n;
+        }
+    }
+}
+
+/*
+ * Allocates the tag array used by SWISS_P, with the first GROUP_SIZE
+ * tags repeated past the end so a group can be loaded from any slot.
+ * @param capacity number of slots in the table
+ * @return tag array with every slot marked empty
+ */
+
+static unsigned char *htable_new_tags(int capacity) {
+    unsigned char *tags = emalloc(capacity + GROUP_SIZE);
+    memset(tags, EMPTY_TAG, capacity + GROUP_SIZE);
+    return tags;
+}
+
+/*
+ * Allocates the counters used for instrumentation, all set to zero.
+ * @return the counters, or NULL if instrumentation is compiled out
+ */
+
+static struct htable_counters *htable_new_counters(void) {
+#ifndef HTABLE_NO_INSTRUMENT
+    struct htable_counters *c = emalloc(sizeof *c);
+    memset(c, 0, sizeof *c);
+    c->until_clock = 1;
+    c->sample_every = 1;
+    c->until_sample = 1;
+    return c;
+#else
+    return NULL;
+#endif
+}
+
+/*
+ * Rounds a capacity up to whole CUCKOO_H buckets and adds the stash.
+ * @param capacity number of slots asked for
+ * @return number of slots the table needs
+ */
+
+static int htable_cuckoo_capacity(int capacity) {
+    int buckets = (capacity + BUCKET_SLOTS - 1) / BUCKET_SLOTS;
+    return (buckets > 0 ? buckets : 1) * BUCKET_SLOTS + STASH_SIZE;
+}
+
+/*
+ * Sets the capacity of a table. A capacity that is a power of two
+ * gets a mask and shift, so slots are found without dividing; any
+ * other capacity, and every CUCKOO_H table, uses %.
+ * @param h hashtable to set the capacity of
+ * @param capacity number of slots
+ */
+
+static void htable_set_capacity(htable h, int capacity) {
+    h->capacity = capacity;
+    h->mask = 0;
+    h->shift = 64;
+    if (capacity > 1 && (capacity & (capacity - 1)) == 0 && h->method != CUCKOO_H) {
+        h->mask = capacity - 1;
+        for (; capacity > 1; capacity >>= 1) {
+            h->shift--;
+        }
+    }
+}
+
 /*
  * Creates and initialises a new, empty hashtable
  * @param capacity size of new hashtable
@@ -30,15 +304,62 @@ struct htablerec {
  */
 
 htable htable_new(int capacity, hashing_t method) {
+    return htable_new_hash(capacity, method, WORD_F);
+}
+
+/*
+ * Creates and initialises a new, empty hashtable that hashes words
+ * with the given hash function.
+ * @param capacity size of new hashtable
+ * @param method manner of collision resolution
+ * @param hash_fn hash function to use for every word
+ * @return h returns initialised but empty hashtable
+ */
+
+htable htable_new_hash(int capacity, hashing_t method, hash_fn_t hash_fn) {
     int i = 0;
 
     htable h = emalloc(sizeof *h);
-    h->capacity = capacity;
-    h->num_keys = 0;
     h->method = method;
+    htable_set_capacity(h, method == CUCKOO_H ? htable_cuckoo_capacity(capacity) : capacity);
+    h->num_keys = 0;
+    h->hash_fn = hash_fn;
+    h->max_load = 0.0;
+    h->rehash_step = 0;
+    h->rehash_pos = 0;
+    h->old = NULL;
+    h->strings = arena_new();
+    h->tags = method == SWISS_P ? htable_new_tags(capacity) : NULL;
+    h->slots = NULL;
+    h->dists = method == ROBIN_H ? emalloc(capacity * sizeof h->dists[0]) : NULL;
+    h->max_dist = 0;
+    h->tombstones = 0;
+    h->stash_used = 0;
+    h->kicks = 0;
+    h->stash_load = 0.0;
+    h->disp = NULL;
+    h->num_buckets = 0;
+    h->num_slots = 0;
+    h->ranks = NULL;
+    h->seed = 0;
+    h->pool = NULL;
+    h->offsets = NULL;
+    h->map = NULL;
+    h->counters = htable_new_counters();
+    h->filter = NULL;
+    h->filter_rejects = 0;
+    h->filter_false = 0;
+    h->stats = emalloc(h->capacity *sizeof h->stats[0]);
+    if (method == INLINE_P) {
+        h->freqs = NULL;
+        h->keys = NULL;
+        h->slots = emalloc(h->capacity * sizeof h->slots[0]);
+        memset(h->slots, 0, h->capacity * sizeof h->slots[0]);
+        memset(h->stats, 0, h->capacity * sizeof h->stats[0]);
+        return h;
+    }
     h->freqs = emalloc(h->capacity *sizeof h->freqs[0]);
     h->keys = emalloc(h->capacity *sizeof h->keys[0]);
-    h->stats = emalloc(h->capacity *sizeof h->stats[0]);
     
     for (i = 0; i < h->capacity; i++) {
         h->freqs[i] = 0;
@@ -54,13 +375,33 @@ htable htable_new(int capacity, hashing_t method) {
  */
 
 void htable_free(htable h) {
-    int i;
-    for(i = 0; i < h->capacity; i++) {
-        if(h->keys[i] != NULL) {
-            free(h->keys[i]);
+    free(h->counters);
+    if (h->map != NULL) {
+        munmap(h->map, h->map_size);
+        free(h);
+        return;
+    }
+    if (h->old != NULL) {
+        if (h->old->filter != NULL) {
+            bloom_free(h->old->filter);
         }
+        free(h->old->slots);
+        free(h->old->tags);
+        free(h->old->dists);
+        free(h->old->freqs);
+        free(h->old->keys);
+        free(h->old);
     }
 
+    if (h->filter != NULL) {
+        bloom_free(h->filter);
+    }
+    arena_free(h->strings);
+    free(h->disp);
+    free(h->ranks);
+    free(h->slots);
+    free(h->tags);
+    free(h->dists);
     free(h->stats);
     free(h->freqs);
     free(h->keys);
@@ -82,196 +423,2360 @@ static unsigned int htable_word_to_int(char *word) {
 }
 
 /*
- * Double hashing step
+ * 64-bit FNV-1a hash of a word, one byte at a time.
+ * @param word word to hash
+ * @return the hash
+ */
+
+static uint64_t htable_fnv1a(char *word) {
+    uint64_t result = UINT64_C(14695981039346656037);
+    while (*word != '\0') {
+        result ^= (unsigned char) *word++;
+        result *= UINT64_C(1099511628211);
+    }
+    return result;
+}
+
+#define WIDE_P1 UINT64_C(11400714785074694791)
+#define WIDE_P2 UINT64_C(14029467366897019727)
+#define WIDE_P3 UINT64_C(1609587929392839161)
+
+/*
+ * 64-bit hash in the style of xxHash64 that reads a word 8 bytes at a
+ * time, with a final mix so every output bit depends on every input
+ * bit.
+ * @param word word to hash
+ * @return the hash
+ */
+
+static uint64_t htable_wide(char *word) {
+    size_t len = strlen(word);
+    uint64_t result = WIDE_P3 + len;
+    uint64_t chunk;
+
+    for (; len >= 8; len -= 8, word += 8) {
+        memcpy(&chunk, word, 8);
+        chunk *= WIDE_P2;
+        chunk = (chunk << 31) | (chunk >> 33);
+        result ^= chunk * WIDE_P1;
+        result = ((result << 27) | (result >> 37)) * WIDE_P1 + WIDE_P3;
+    }
+    if (len > 0) {
+        chunk = 0;
+        memcpy(&chunk, word, len);
+        result ^= chunk * WIDE_P1;
+        result = ((result << 23) | (result >> 41)) * WIDE_P2;
+    }
+    result ^= result >> 33;
+    result *= WIDE_P2;
+    result ^= result >> 29;
+    result *= WIDE_P3;
+    result ^= result >> 32;
+    return result;
+}
+
+/*
+ * Hashes a word with the hash function chosen for the table. The low
+ * 32 bits pick the home slot and the high 32 bits the double hashing
+ * step. The original hash only has 32 bits, so it is repeated in both
+ * halves, which keeps its tables the same as they always were.
+ * @param h hashtable the word is for
+ * @param word word to hash
+ * @return the hash
+ */
+
+static uint64_t htable_hash(htable h, char *word) {
+    uint64_t result;
+
+    switch (h->hash_fn) {
+        case FNV1A_F:
+            return htable_fnv1a(word);
+        case WIDE_F:
+            return htable_wide(word);
+        default:
+            result = htable_word_to_int(word);
+            return result << 32 | result;
+    }
+}
+
+/*
+ * Home slot of a hash. A power of two capacity takes the top bits of
+ * a multiplicative hash, as the low bits of the word hash are weak.
+ * @param h hashtable
+ * @param key hash of the word
+ * @return index of the home slot
+ */
+
+static unsigned int htable_home(htable h, uint64_t key) {
+    if (h->mask != 0) {
+        return (unsigned int) ((key * WIDE_P1) >> h->shift);
+    }
+    return (unsigned int) key % h->capacity;
+}
+
+/*
+ * Double hashing step. With a power of two capacity the step is made
+ * odd, so it still visits every slot.
  * @param h hasthable
- * @param i_key value of key
+ * @param key hash of the word
  * @return size of step
  */
 
-static unsigned int htable_step(htable h, unsigned int i_key) {
-    return 1 + (i_key % (h->capacity - 1));
+static unsigned int htable_step(htable h, uint64_t key) {
+    if (h->mask != 0) {
+        return ((unsigned int) (key >> 32) | 1) & h->mask;
+    }
+    return 1 + ((unsigned int) (key >> 32) % (h->capacity - 1));
 }
 
 /*
- * Inserts a word into the hashtable or increases the frequency of
- * the word if it is already in the hashtable. And keeps track of the
- * number of keys/words in the hashtable.
- * @param h hashtable we are inserting into
- * @param str the word we are inserting
- * @return success(1) or failure(0) of insertion
+ * Brings a slot number that has run past the end of the table back
+ * into range.
+ * @param h hashtable
+ * @param index slot number, possibly past the end
+ * @return the slot it wraps around to
  */
 
-int htable_insert(htable h, char *str) {
-    unsigned int key = htable_word_to_int(str);
-    unsigned int index = key%h->capacity;
-    unsigned int step = (h->method == LINEAR_P) ? 1: htable_step(h, key);
-    int coll = 0;
-    
-    if (h->keys[index] == NULL) {
-        h->keys[index] = emalloc(strlen(str)+1 * sizeof h->keys[0]);
-        strcpy(h->keys[index], str);
-        h->freqs[index] = 1;
-        h->stats[h->num_keys] = coll;
-        h->num_keys++;
-        return 1;
-    }
-    else if (strcmp(h->keys[index], str) == 0) {
-        return ++h->freqs[index];
-    }
-    while (h->keys[index] != NULL && strcmp(h->keys[index], str) != 0) {
-        index = (index + step) % h->capacity;
-        coll++;
-        if (h->keys[index] == NULL){
-            h->keys[index] = emalloc(strlen(str)+1 * sizeof h->keys[0]);
-            strcpy(h->keys[index], str);
-            h->freqs[index] = 1;
-            h->stats[h->num_keys] = coll;
-            h->num_keys++;
-        }
-        else if (strcmp(h->keys[index], str) == 0) {
-            h->freqs[index]++;
-            return h->freqs[index];
-        }
-        if (coll == h->capacity) {
-            return 0;
+static unsigned int htable_wrap(htable h, unsigned int index) {
+    return h->mask != 0 ? index & h->mask : index % h->capacity;
+}
+
+/*
+ * strcmp, counted for instrumentation.
+ * @param h hashtable the comparison is for
+ * @param key word from the table
+ * @param str word being looked for
+ * @return the result of strcmp
+ */
+
+static int htable_keycmp(htable h, char *key, char *str) {
+#ifndef HTABLE_NO_INSTRUMENT
+    h->counters->strcmps++;
+#else
+    (void) h;
+#endif
+    return strcmp(key, str);
+}
+
+/*
+ * Returns the word in a slot, wherever the table keeps it.
+ * @param h hashtable
+ * @param index the slot
+ * @return the word, or NULL if the slot is empty
+ */
+
+static char *htable_key(htable h, int index) {
+    if (h->slots != NULL) {
+        if (h->slots[index].freq == 0) {
+            return NULL;
         }
+        return h->slots[index].len < INLINE_KEY ? h->slots[index].key
+            : h->slots[index].spill;
     }
-    return 0;
+    if (h->pool == NULL) {
+        return h->keys[index];
+    }
+    if (h->offsets[index] == SNAPSHOT_EMPTY || h->offsets[index] == SNAPSHOT_DELETED) {
+        return NULL;
+    }
+    return h->pool + h->offsets[index] - 1;
 }
 
 /*
- * Searches the hashtable for a given word.
- * @param h hashtable to search
- * @param str word to look for
- * @return frequence of str in hashtable
+ * Returns the frequency of the word in a slot, wherever the table
+ * keeps it.
+ * @param h hashtable
+ * @param index the slot
+ * @return the frequency
  */
 
-int htable_search(htable h, char *str) {
-    int coll = 0;
-    unsigned int key = htable_word_to_int(str);
-    unsigned int index = key%h->capacity;
-    unsigned int step = (h->method == LINEAR_P) ? 1: htable_step(h, key);
+static int htable_freq(htable h, int index) {
+    return h->slots != NULL ? h->slots[index].freq : h->freqs[index];
+}
 
-    while(h->keys[index] != NULL && strcmp(h->keys[index], str) != 0 && coll < h->capacity) {
-        index = (index + step) % h->capacity;
-        coll++;
+/*
+ * INLINE_P version of htable_find. The length and the first
+ * INLINE_KEY bytes are compared in the slot, so only a long word that
+ * matches them all needs the rest of the word fetched.
+ * @param h hashtable using INLINE_P
+ * @param str the word we are looking for
+ * @param len length of str
+ * @param key hash of str from htable_hash
+ * @param coll set to the number of collisions along the way
+ * @return index of str or of the empty slot where it belongs, or -1
+ * if every slot was probed without finding either
+ */
+
+static int htable_find_inline(htable h, char *str, int len, uint64_t key, int *coll) {
+    unsigned int index = htable_home(h, key);
+    struct inline_slot *slot;
+
+    for (*coll = 0; *coll < h->capacity; (*coll)++) {
+        slot = &h->slots[index];
+        if (slot->freq == 0) {
+            return index;
+        }
+        if (slot->len == len) {
+#ifndef HTABLE_NO_INSTRUMENT
+            h->counters->strcmps++;
+#endif
+            if (len < INLINE_KEY ? memcmp(slot->key, str, len) == 0
+                : memcmp(slot->key, str, INLINE_KEY) == 0
+                && strcmp(slot->spill + INLINE_KEY, str + INLINE_KEY) == 0) {
+                return index;
+            }
+        }
+        index = htable_wrap(h, index + 1);
     }
+    return -1;
+}
 
-    if (coll == h->capacity) {
-        return 0;
+/*
+ * Puts a word into an empty INLINE_P slot.
+ * @param h hashtable using INLINE_P
+ * @param index the empty slot
+ * @param str the word
+ * @param len length of str
+ * @param spill a copy of str in h->strings if it is too long to fit
+ * in the slot, or NULL to make one
+ * @param freq frequency of the word
+ */
+
+static void htable_fill_inline(htable h, int index, char *str, int len, char *spill,
+                               int freq) {
+    struct inline_slot *slot = &h->slots[index];
 
+    if (len < INLINE_KEY) {
+        memcpy(slot->key, str, len + 1);
+        slot->spill = NULL;
+    } else {
+        memcpy(slot->key, str, INLINE_KEY);
+        slot->spill = spill != NULL ? spill : arena_strdup(h->strings, str);
     }
+    slot->len = len;
+    slot->freq = freq;
+}
+
+/*
+ * Seven bits of the hash, taken from the top of a multiplicative
+ * hash so they are independent of the home slot.
+ * @param key hash of the word
+ * @return tag for the word
+ */
 
-    return h->freqs[index];
+static unsigned char htable_tag(uint64_t key) {
+    return (unsigned char) (((unsigned int) key * 2654435761u) >> 25);
 }
 
 /*
- * passed into htable_print
- * @param freq frequency of word
- * @param word the word we want information about
+ * Sets the tag of a slot, along with its copy past the end of the
+ * array if it is one of the first GROUP_SIZE slots.
+ * @param h hashtable using SWISS_P
+ * @param index slot to set the tag of
+ * @param tag new tag for the slot
+ */
 
- static void print_info(int freq, char *word) {
- printf("%-4d %s\n", freq, word);
- }
-*/
+static void htable_set_tag(htable h, int index, unsigned char tag) {
+    int i;
+    h->tags[index] = tag;
+    for (i = index; i < GROUP_SIZE; i += h->capacity) {
+        h->tags[h->capacity + i] = tag;
+    }
+}
 
 /*
- * prints the frequency and keys in the hashtable
- * @param h hashtable we want to print
+ * Compares the GROUP_SIZE tags starting at tags with tag.
+ * @param tags first tag of the group
+ * @param tag tag to look for
+ * @return bitmask with bit i set if tags[i] is equal to tag
  */
 
-void htable_print(htable h, void p(int freq, char *word)) {
+static unsigned int htable_match(unsigned char *tags, unsigned char tag) {
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128((const __m128i *) tags);
+    return (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(group,
+                                                           _mm_set1_epi8((char) tag)));
+#else
+    unsigned int mask = 0;
     int i;
-    for (i=0; i < h->capacity; i++) {
-        if (h->keys[i] != NULL) {
-            p(h->freqs[i], h->keys[i]);
+    for (i = 0; i < GROUP_SIZE; i++) {
+        if (tags[i] == tag) {
+            mask |= 1u << i;
         }
     }
+    return mask;
+#endif
 }
 
 /*
- * Print out a line of data from the hash table to reflect the state
- * the table was in when it was a certain percentage full.
- * Note: If the hashtable is less full than percent_full then no data
- * will be printed.
- * @param h - the hash table
- * @param stream - a stream to print the data to
- * @param percent_full - the point at which to show the data from.
+ * Returns the index of the lowest set bit of a nonzero mask.
  */
 
-static void print_stats_line(htable h, FILE *stream, int percent_full) {
-    int current_entries = h->capacity * percent_full / 100;
-    double average_collisions = 0.0;
-    int at_home = 0;
-    int max_collisions = 0;
+static int htable_first_bit(unsigned int mask) {
+#ifdef __GNUC__
+    return __builtin_ctz(mask);
+#else
     int i = 0;
+    while ((mask & 1u) == 0) {
+        mask >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
 
-    if (current_entries > 0 && current_entries <= h->num_keys) {
-        for (i = 0; i < current_entries; i++) {
-            if (h->stats[i] == 0) {
-                at_home++;
-            }
-            if (h->stats[i] > max_collisions) {
-                max_collisions = h->stats[i];
+/*
+ * SWISS_P version of htable_find. Tags are checked a group at a time
+ * and strcmp is only called on slots whose tag matches.
+ * @param h hashtable to probe
+ * @param str the word we are looking for
+ * @param key hash of str from htable_hash
+ * @param coll set to the distance of the returned slot from home
+ * @return index of str or of the empty slot where it belongs, or -1
+ * if every slot was probed without finding either. If str is not in
+ * the table the first tombstone along the way is reused.
+ */
+
+static int htable_find_group(htable h, char *str, uint64_t key, int *coll) {
+    unsigned int home = htable_home(h, key);
+    unsigned int pos = home;
+    unsigned char tag = htable_tag(key);
+    unsigned int match, empty, deleted;
+    int probed, index, tomb = -1;
+
+    for (probed = 0; probed < h->capacity; probed += GROUP_SIZE) {
+        match = htable_match(h->tags + pos, tag);
+        empty = htable_match(h->tags + pos, EMPTY_TAG);
+        deleted = tomb == -1 ? htable_match(h->tags + pos, DELETED_TAG) : 0;
+        /* anything past the first empty slot was placed after str would be */
+        if (empty != 0) {
+            match &= (empty & -empty) - 1;
+            deleted &= (empty & -empty) - 1;
+        }
+        if (deleted != 0) {
+            tomb = htable_wrap(h, pos + htable_first_bit(deleted));
+        }
+        while (match != 0) {
+            index = htable_wrap(h, pos + htable_first_bit(match));
+            if (htable_keycmp(h, h->keys[index], str) == 0) {
+                *coll = htable_wrap(h, index + h->capacity - home);
+                return index;
             }
-            average_collisions += h->stats[i];
+            match &= match - 1;
         }
+        if (empty != 0) {
+            index = tomb != -1 ? tomb : (int) htable_wrap(h, pos + htable_first_bit(empty));
+            *coll = htable_wrap(h, index + h->capacity - home);
+            return index;
+        }
+        pos = htable_wrap(h, pos + GROUP_SIZE);
+    }
+    if (tomb != -1) {
+        *coll = htable_wrap(h, tomb + h->capacity - home);
+    }
+    return tomb;
+}
 
-        fprintf(stream, "%4d %10d %11.1f %10.2f %11d\n", percent_full,
-                current_entries, at_home * 100.0 / current_entries,
-                average_collisions / current_entries, max_collisions);
+/*
+ * ROBIN_H version of htable_find. Keys in a run are ordered by their
+ * distance from home, so the search can stop as soon as it reaches a
+ * key that is closer to home than str would be, or once it has gone
+ * further than any key in the table.
+ * @param h hashtable to probe
+ * @param str the word we are looking for
+ * @param key hash of str from htable_hash
+ * @param coll set to the distance of str from home
+ * @return index of str, or -1 if it is not in the table
+ */
+
+static int htable_find_robin(htable h, char *str, uint64_t key, int *coll) {
+    int index = htable_home(h, key);
+
+    for (*coll = 0; *coll <= h->max_dist; (*coll)++) {
+        if (h->keys[index] == NULL || h->dists[index] < *coll) {
+            return -1;
+        }
+        if (htable_keycmp(h, h->keys[index], str) == 0) {
+            return index;
+        }
+        index = htable_wrap(h, index + 1);
     }
+    return -1;
 }
 
 /*
- * Prints out a table showing what the following attributes were like
- * at regular intervals (as detemined by num_stats) while the
- * hashtable was being built.
- *
- * @li Percent At Home - how many keys were placed without a collision
- * occuring
- * @li Average Collisions - how many collisions have occurred on
- * average while placing all of the keys so far.
- * @li Maximum Collisions - the most collisions that have occurred
- * while placing a key.
- *
- * @param h the hashtable to print statistics summary from.
- * @param stream the stream to send output to.
- * @param num_stats the maximum number of statistical snapshots to print.
+ * Adds a word that is not yet in a ROBIN_H table. Walking from home,
+ * the word takes the slot of the first key that is closer to its own
+ * home, and that key carries on looking for a slot further along.
+ * @param h hashtable with at least one empty slot
+ * @param str the word to add, already copied into h->strings
+ * @param key hash of str from htable_hash
+ * @param freq frequency of the word
+ * @return the distance of str from its home slot
  */
 
-void htable_print_stats(htable h, FILE *stream, int num_stats) {
-    int i;
+static int htable_robin_place(htable h, char *str, uint64_t key, int freq) {
+    int index = htable_home(h, key);
+    int dist = 0, str_dist = -1;
+    char *tmp_key;
+    int tmp;
 
-    fprintf(stream, "\n%s\n\n",
-            h->method == LINEAR_P ? "Linear Probing" : "Double Hashing");
-    fprintf(stream, "Percent   Current    Percent    Average      Maximum\n");
-    fprintf(stream, " Full     Entries    At Home   Collisions   Collisions\n");
-    fprintf(stream, "------------------------------------------------------\n");
-    for (i = 1; i <= num_stats; i++) {
-        print_stats_line(h, stream, 100 * i / num_stats);
+    while (h->keys[index] != NULL) {
+        if (h->dists[index] < dist) {
+            if (str_dist == -1) {
+                str_dist = dist;
+            }
+            if (dist > h->max_dist) {
+                h->max_dist = dist;
+            }
+            tmp_key = h->keys[index];
+            h->keys[index] = str;
+            str = tmp_key;
+            tmp = h->freqs[index];
+            h->freqs[index] = freq;
+            freq = tmp;
+            tmp = h->dists[index];
+            h->dists[index] = dist;
+            dist = tmp;
+        }
+        index = htable_wrap(h, index + 1);
+        dist++;
     }
-    fprintf(stream, "------------------------------------------------------\n\n");
+    h->keys[index] = str;
+    h->freqs[index] = freq;
+    h->dists[index] = dist;
+    if (dist > h->max_dist) {
+        h->max_dist = dist;
+    }
+    return str_dist == -1 ? dist : str_dist;
 }
 
 /*
- * Prints the entire hashtable in a readable format
- * @param h the hashtable we're reading
- * @param stream the stream to send output to
+ * Spreads the bits of a hash out again, so that a CUCKOO_H word gets
+ * a second bucket even from a hash whose two halves are the same,
+ * and a frozen table can derive new hashes from a seed.
+ * @param key hash of the word
+ * @return the mixed hash
  */
 
-void htable_print_entire_table(htable h, FILE *stream) {
-    int i;
+static uint64_t htable_mix(uint64_t key) {
+    key ^= key >> 33;
+    key *= UINT64_C(0xff51afd7ed558ccd);
+    key ^= key >> 33;
+    key *= UINT64_C(0xc4ceb9fe1a85ec53);
+    key ^= key >> 33;
+    return key;
+}
 
-    fprintf(stream, "  Pos  Freq  Stats  Word\n");
-    fprintf(stream, "----------------------------------------\n");
+/*
+ * First slot of one of the two buckets of a CUCKOO_H word. The first
+ * bucket comes from the low half of the hash, like htable_home, and
+ * the second from the high half of the mixed hash. The two are never
+ * the same bucket unless there is only one.
+ * @param h hashtable using CUCKOO_H
+ * @param key hash of the word
+ * @param which 0 for the first bucket, or 1 for the second
+ * @return index of the first slot of the bucket
+ */
 
-    for (i=0; i < h->capacity; i++) {
-        if (h->keys[i] != NULL) {
-            fprintf(stream, "%5d %5d %5d   %s\n", i, h->freqs[i], h->stats[i], h->keys[i]);
-        }
-        else {
-            fprintf(stream, "%5d %5d %5d   \n", i, h->freqs[i], h->stats[i]);
-        }
+static unsigned int htable_bucket(htable h, uint64_t key, int which) {
+    unsigned int buckets = (h->capacity - STASH_SIZE) / BUCKET_SLOTS;
+    unsigned int first = (unsigned int) key % buckets;
+    unsigned int second = (unsigned int) (htable_mix(key) >> 32) % buckets;
+
+    if (which == 0) {
+        return first * BUCKET_SLOTS;
     }
+    return (second != first ? second : (first + 1) % buckets) * BUCKET_SLOTS;
+}
+
+/*
+ * CUCKOO_H version of htable_find. Only the two buckets of str, and
+ * the stash if anything is in it, are ever looked at. Mapped tables
+ * do not record how much of the stash is in use, so always check it.
+ * @param h hashtable to search
+ * @param str the word we are looking for
+ * @param key hash of str from htable_hash
+ * @param coll set to 0 for the first bucket, 1 for the second and 2
+ * for the stash
+ * @return index of str, or -1 if it is not in the table
+ */
+
+static int htable_find_cuckoo(htable h, char *str, uint64_t key, int *coll) {
+    unsigned int index;
+    char *slot;
+    int i;
+
+    for (*coll = 0; *coll < 2; (*coll)++) {
+        index = htable_bucket(h, key, *coll);
+        for (i = 0; i < BUCKET_SLOTS; i++) {
+            slot = htable_key(h, index + i);
+            if (slot != NULL && htable_keycmp(h, slot, str) == 0) {
+                return index + i;
+            }
+        }
+    }
+    if (h->stash_used > 0 || h->map != NULL) {
+        for (index = h->capacity - STASH_SIZE; index < (unsigned int) h->capacity; index++) {
+            slot = htable_key(h, index);
+            if (slot != NULL && htable_keycmp(h, slot, str) == 0) {
+                return index;
+            }
+        }
+    }
+    return -1;
+}
+
+/*
+ * Adds a word that is not yet in a CUCKOO_H table. If both of its
+ * buckets are full, a word is moved out of one of them into its own
+ * other bucket, and that word takes the place of the one being added.
+ * After MAX_KICKS moves the word in hand goes into the stash instead.
+ * The caller makes sure there is room in the stash; with no room the
+ * moves carry on until a bucket has space, which only a rehash into a
+ * much emptier table relies on.
+ * @param h hashtable using CUCKOO_H
+ * @param str the word to add, already copied into h->strings
+ * @param key hash of str from htable_hash
+ * @param freq frequency of the word
+ * @return the number of words that were moved
+ */
+
+static int htable_cuckoo_place(htable h, char *str, uint64_t key, int freq) {
+    unsigned int bucket, from = h->capacity;
+    unsigned int index;
+    char *tmp_key;
+    int kicks, tmp, i;
+
+    for (kicks = 0;; kicks++) {
+        for (i = 0; i < 2 * BUCKET_SLOTS; i++) {
+            index = htable_bucket(h, key, i / BUCKET_SLOTS) + i % BUCKET_SLOTS;
+            if (h->keys[index] == NULL) {
+                h->keys[index] = str;
+                h->freqs[index] = freq;
+                break;
+            }
+        }
+        if (i < 2 * BUCKET_SLOTS) {
+            break;
+        }
+        if (kicks >= MAX_KICKS && h->stash_used < STASH_SIZE) {
+            for (index = h->capacity - STASH_SIZE; h->keys[index] != NULL; index++)
+                ;
+            h->keys[index] = str;
+            h->freqs[index] = freq;
+            if (h->stash_used++ == 0) {
+                h->stash_load = (double) h->num_keys / h->capacity;
+            }
+            break;
+        }
+        /* never send a word straight back to the bucket it came from */
+        bucket = htable_bucket(h, key, 0);
+        if (bucket == from) {
+            bucket = htable_bucket(h, key, 1);
+        }
+        index = bucket + (unsigned int) (htable_mix(key) >> 30) % BUCKET_SLOTS;
+        tmp_key = h->keys[index];
+        h->keys[index] = str;
+        str = tmp_key;
+        tmp = h->freqs[index];
+        h->freqs[index] = freq;
+        freq = tmp;
+        key = htable_hash(h, str);
+        from = bucket;
+    }
+    h->kicks += kicks;
+    if (kicks > h->max_dist) {
+        h->max_dist = kicks;
+    }
+    return kicks;
+}
+
+/*
+ * Follows the probe sequence for str until it finds either str or an
+ * empty slot.
+ * @param h hashtable to probe
+ * @param str the word we are looking for
+ * @param key hash of str from htable_hash
+ * @param coll set to the number of collisions along the way
+ * @return index of str or of the empty slot where it belongs, or -1
+ * if every slot was probed without finding either. If str is not in
+ * the table the first tombstone along the way is reused.
+ */
+
+static int htable_find(htable h, char *str, uint64_t key, int *coll) {
+    unsigned int index = htable_home(h, key);
+    unsigned int step = (h->method == DOUBLE_H) ? htable_step(h, key) : 1;
+    int tomb = -1, tomb_coll = 0;
+
+    if (h->method == SWISS_P) {
+        return htable_find_group(h, str, key, coll);
+    }
+    if (h->method == ROBIN_H) {
+        return htable_find_robin(h, str, key, coll);
+    }
+    if (h->method == CUCKOO_H) {
+        return htable_find_cuckoo(h, str, key, coll);
+    }
+    *coll = 0;
+    while (h->keys[index] == NULL ? h->freqs[index] == DELETED
+           : htable_keycmp(h, h->keys[index], str) != 0) {
+        if (h->keys[index] == NULL && tomb == -1) {
+            tomb = index;
+            tomb_coll = *coll;
+        }
+        index = htable_wrap(h, index + step);
+        if (++*coll == h->capacity) {
+            break;
+        }
+    }
+    if ((*coll == h->capacity || h->keys[index] == NULL) && tomb != -1) {
+        *coll = tomb_coll;
+        return tomb;
+    }
+    return *coll == h->capacity ? -1 : (int) index;
+}
+
+/*
+ * Fills an empty slot found by htable_find.
+ * @param h hashtable to fill a slot of
+ * @param index the empty slot
+ * @param str the word to put there, already copied into h->strings
+ * @param key hash of str from htable_hash
+ * @param freq frequency of the word
+ */
+
+static void htable_fill(htable h, int index, char *str, uint64_t key, int freq) {
+    if (h->freqs[index] == DELETED) {
+        h->tombstones--;
+    }
+    h->keys[index] = str;
+    h->freqs[index] = freq;
+    if (h->method == SWISS_P) {
+        htable_set_tag(h, index, htable_tag(key));
+    }
+}
+
+/*
+ * Moves up to h->rehash_step slots from the table being drained into
+ * h. Once the last slot has been moved the old arrays are freed. The
+ * keys stay where they are in h->strings, and so do the long words of
+ * INLINE_P, whose short words are copied from slot to slot.
+ * @param h hashtable that is part way through a rehash
+ * @param all nonzero to move every remaining slot at once
+ */
+
+static void htable_rehash(htable h, int all) {
+    htable old = h->old;
+    int moved = 0;
+    uint64_t key;
+    int coll, index;
+    struct inline_slot *slot;
+
+    while (h->rehash_pos < old->capacity && (all || moved < h->rehash_step)) {
+        if (old->slots != NULL) {
+            slot = &old->slots[h->rehash_pos];
+            if (slot->freq != 0) {
+                key = htable_hash(h, htable_key(old, h->rehash_pos));
+                index = htable_find_inline(h, htable_key(old, h->rehash_pos), slot->len,
+                                           key, &coll);
+                htable_fill_inline(h, index, htable_key(old, h->rehash_pos), slot->len,
+                                   slot->spill, slot->freq);
+                if (h->filter != NULL) {
+                    bloom_add(h->filter, key);
+                }
+            }
+        } else if (old->keys[h->rehash_pos] != NULL) {
+            key = htable_hash(h, old->keys[h->rehash_pos]);
+            if (h->method == ROBIN_H) {
+                htable_robin_place(h, old->keys[h->rehash_pos], key,
+                                   old->freqs[h->rehash_pos]);
+            } else if (h->method == CUCKOO_H) {
+                htable_cuckoo_place(h, old->keys[h->rehash_pos], key,
+                                    old->freqs[h->rehash_pos]);
+            } else {
+                index = htable_find(h, old->keys[h->rehash_pos], key, &coll);
+                htable_fill(h, index, old->keys[h->rehash_pos], key,
+                            old->freqs[h->rehash_pos]);
+            }
+            if (h->filter != NULL) {
+                bloom_add(h->filter, key);
+            }
+        }
+        h->rehash_pos++;
+        moved++;
+    }
+    if (h->rehash_pos == old->capacity) {
+        if (old->filter != NULL) {
+            bloom_free(old->filter);
+        }
+        free(old->slots);
+        free(old->tags);
+        free(old->dists);
+        free(old->freqs);
+        free(old->keys);
+        free(old);
+        h->old = NULL;
+        h->rehash_pos = 0;
+    }
+}
+
+/*
+ * Replaces the arrays of h with new ones. The current arrays become
+ * h->old and are drained into the new ones a few slots at a time by
+ * later calls to htable_insert. Tombstones are left behind, and so are
+ * removed keys in the Bloom filter, which is started again empty.
+ * @param h hashtable to resize
+ * @param capacity size of the new arrays
+ */
+
+static void htable_resize(htable h, int capacity) {
+    int i;
+
+    if (h->old != NULL) {
+        htable_rehash(h, 1);
+    }
+    h->old = emalloc(sizeof *h->old);
+    h->old->keys = h->keys;
+    h->old->slots = h->slots;
+    h->old->freqs = h->freqs;
+    h->old->tags = h->tags;
+    h->old->dists = h->dists;
+    h->old->max_dist = h->max_dist;
+    h->old->stash_used = h->stash_used;
+    h->old->capacity = h->capacity;
+    h->old->mask = h->mask;
+    h->old->shift = h->shift;
+    h->old->method = h->method;
+    h->old->hash_fn = h->hash_fn;
+    h->old->stats = NULL;
+    h->old->strings = NULL;
+    h->old->pool = NULL;
+    h->old->map = NULL;
+    h->old->counters = h->counters;
+    h->old->filter = h->filter;
+    h->old->old = NULL;
+    h->rehash_pos = 0;
+
+    htable_set_capacity(h, capacity);
+    h->tombstones = 0;
+    h->stash_used = 0;
+    if (h->slots != NULL) {
+        h->slots = emalloc(h->capacity * sizeof h->slots[0]);
+        memset(h->slots, 0, h->capacity * sizeof h->slots[0]);
+    } else {
+        h->freqs = emalloc(h->capacity * sizeof h->freqs[0]);
+        h->keys = emalloc(h->capacity * sizeof h->keys[0]);
+        for (i = 0; i < h->capacity; i++) {
+            h->freqs[i] = 0;
+            h->keys[i] = NULL;
+        }
+    }
+    h->tags = h->method == SWISS_P ? htable_new_tags(h->capacity) : NULL;
+    h->dists = h->method == ROBIN_H
+        ? emalloc(h->capacity * sizeof h->dists[0]) : NULL;
+    h->max_dist = 0;
+    h->filter = h->filter != NULL ? bloom_new(h->capacity) : NULL;
+    h->stats = erealloc(h->stats, h->capacity * sizeof h->stats[0]);
+    for (i = h->old->capacity; i < h->capacity; i++) {
+        h->stats[i] = 0;
+    }
+}
+
+/*
+ * Looks for str in the part of h->old that has not been moved yet.
+ * @param h hashtable that may be part way through a rehash
+ * @param str the word to look for
+ * @param key hash of str from htable_hash
+ * @param coll set to the number of collisions along the way
+ * @return index of str in h->old, or -1 if it is not there
+ */
+
+static int htable_find_old(htable h, char *str, uint64_t key, int *coll) {
+    int index;
+
+    *coll = 0;
+    if (h->old == NULL) {
+        return -1;
+    }
+    index = h->old->slots != NULL
+        ? htable_find_inline(h->old, str, strlen(str), key, coll)
+        : htable_find(h->old, str, key, coll);
+    if (index < h->rehash_pos || htable_key(h->old, index) == NULL) {
+        return -1;
+    }
+    return index;
+}
+
+/*
+ * Makes the table grow by itself once more than max_load of it is in
+ * use. The move to the bigger table is spread over the inserts that
+ * follow, so no single insert has to rehash every key.
+ * @param h hashtable to set the load factor of
+ * @param max_load fraction of the table in use that triggers a resize,
+ * or 0 to keep the capacity fixed
+ */
+
+void htable_set_max_load(htable h, double max_load) {
+    h->max_load = max_load;
+    /* drain the old table before the new one can fill up again */
+    h->rehash_step = max_load > 0.0 ? 1 + (int) (1.0 / max_load) : 0;
+}
+
+/*
+ * Puts a blocked Bloom filter in front of the table. Every word
+ * inserted from now on, and every word already there, is added to it,
+ * and a search for a word the filter has never seen returns 0 without
+ * probing the table. The filter is sized for a full table and is
+ * rebuilt whenever the table is. It does nothing for a mapped table.
+ * @param h hashtable to filter searches of
+ */
+
+void htable_use_filter(htable h) {
+    int i;
+
+    if (h->map != NULL || h->disp != NULL || h->filter != NULL) {
+        return;
+    }
+    if (h->old != NULL) {
+        htable_rehash(h, 1);
+    }
+    h->filter = bloom_new(h->capacity);
+    for (i = 0; i < h->capacity; i++) {
+        if (htable_key(h, i) != NULL) {
+            bloom_add(h->filter, htable_hash(h, htable_key(h, i)));
+        }
+    }
+}
+
+/*
+ * Returns the number of set bits in a mask.
+ */
+
+static int htable_count_bits(uint64_t mask) {
+#ifdef __GNUC__
+    return __builtin_popcountll(mask);
+#else
+    int count = 0;
+
+    for (; mask != 0; mask &= mask - 1) {
+        count++;
+    }
+    return count;
+#endif
+}
+
+/*
+ * Bucket of a word in a frozen table.
+ * @param h frozen hashtable
+ * @param key hash of the word from htable_hash
+ * @return the bucket
+ */
+
+static unsigned int htable_frozen_bucket(htable h, uint64_t key) {
+    return (unsigned int) (htable_mix(key ^ h->seed) >> 32) % h->num_buckets;
+}
+
+/*
+ * Slot of a word in a frozen table, given the displacement of its
+ * bucket.
+ * @param h frozen hashtable
+ * @param key hash of the word from htable_hash
+ * @param disp displacement of the bucket of the word
+ * @return the slot
+ */
+
+static unsigned int htable_frozen_slot(htable h, uint64_t key, uint32_t disp) {
+    return (unsigned int) (htable_mix(htable_mix(key ^ h->seed) + disp * WIDE_P1)
+                           % h->num_slots);
+}
+
+/*
+ * Index of a word in a frozen table, given its slot.
+ * @param h frozen hashtable
+ * @param slot slot from htable_frozen_slot
+ * @return index into h->keys and h->freqs, or -1 if no word has the
+ * slot
+ */
+
+static int htable_frozen_index(htable h, unsigned int slot) {
+    struct rank_word *word = &h->ranks[slot / 64];
+    uint64_t bit = (uint64_t) 1 << (slot % 64);
+
+    if ((word->used & bit) == 0) {
+        return -1;
+    }
+    return (int) word->rank + htable_count_bits(word->used & (bit - 1));
+}
+
+/*
+ * Finds a displacement for every bucket of the words, as described
+ * above FREEZE_LAMBDA.
+ * @param h hashtable with its seed and number of buckets set
+ * @param hashes hash of every word
+ * @param n number of words
+ * @param disp set to the displacement of every bucket
+ * @param order set to the words sorted by bucket
+ * @param taken rank words to mark used slots in, all 0 to start with
+ * @return 1 on success, or 0 if a bucket could not be placed
+ */
+
+static int htable_displace(htable h, uint64_t *hashes, int n, uint32_t *disp,
+                           int *order, struct rank_word *taken) {
+    int *start = emalloc((h->num_buckets + 1) * sizeof start[0]);
+    int *by_size = emalloc(h->num_buckets * sizeof by_size[0]);
+    int *count = emalloc((n + 2) * sizeof count[0]);
+    int i, j, b, size, ok = 1;
+    unsigned int slot;
+    uint64_t bit;
+    uint32_t d;
+
+    /* counting sort of the words by bucket, then of the buckets by size */
+    memset(start, 0, (h->num_buckets + 1) * sizeof start[0]);
+    for (i = 0; i < n; i++) {
+        start[htable_frozen_bucket(h, hashes[i]) + 1]++;
+    }
+    memset(count, 0, (n + 2) * sizeof count[0]);
+    for (b = 0; b < h->num_buckets; b++) {
+        count[start[b + 1]]++;
+        start[b + 1] += start[b];
+    }
+    for (i = 0; i < n; i++) {
+        order[start[htable_frozen_bucket(h, hashes[i])]++] = i;
+    }
+    for (b = h->num_buckets; b > 0; b--) {
+        start[b] = start[b - 1];
+    }
+    start[0] = 0;
+    for (size = n; size > 0; size--) {
+        count[size - 1] += count[size];
+    }
+    for (b = 0; b < h->num_buckets; b++) {
+        by_size[--count[start[b + 1] - start[b]]] = b;
+    }
+
+    for (i = 0; i < h->num_buckets && ok; i++) {
+        b = by_size[i];
+        size = start[b + 1] - start[b];
+        for (d = 0; d < FREEZE_MAX_DISP; d++) {
+            for (j = 0; j < size; j++) {
+                slot = htable_frozen_slot(h, hashes[order[start[b] + j]], d);
+                bit = (uint64_t) 1 << (slot % 64);
+                if (taken[slot / 64].used & bit) {
+                    break;
+                }
+                taken[slot / 64].used |= bit;
+            }
+            if (j == size) {
+                break;
+            }
+            /* give back the slots this displacement took */
+            while (j-- > 0) {
+                slot = htable_frozen_slot(h, hashes[order[start[b] + j]], d);
+                taken[slot / 64].used &= ~((uint64_t) 1 << (slot % 64));
+            }
+        }
+        disp[b] = d;
+        ok = d < FREEZE_MAX_DISP;
+    }
+    free(count);
+    free(by_size);
+    free(start);
+    return ok;
+}
+
+/*
+ * Turns the hashtable into a read-only minimal perfect hash. Every
+ * word gets a slot of its own, found from its hash and the
+ * displacement of its bucket, and the rank of that slot among the
+ * used ones is its index in arrays exactly num_keys long. So a search
+ * reads one displacement, one rank word and one key and calls strcmp
+ * once. Words are
+ * hashed with WIDE_F from then on, as the 32-bit hash of WORD_F can
+ * give two words the same hash. Searches work as before; inserts and
+ * removals return 0. It does nothing for a mapped table.
+ * @param h hashtable to freeze
+ * @return 1 if the table is frozen, or 0 if no minimal perfect hash
+ * was found, in which case the table is left as it was
+ */
+
+int htable_freeze(htable h) {
+    int n = h->num_keys;
+    uint64_t *hashes = emalloc((n > 0 ? n : 1) * sizeof hashes[0]);
+    int *order = emalloc((n > 0 ? n : 1) * sizeof order[0]);
+    char **words = emalloc((n > 0 ? n : 1) * sizeof words[0]);
+    int *freqs = emalloc((n > 0 ? n : 1) * sizeof freqs[0]);
+    char **keys;
+    int i, j, num_words, attempt, ok = 0;
+    uint32_t rank;
+
+    if (h->map != NULL || h->disp != NULL) {
+        free(hashes);
+        free(order);
+        free(words);
+        free(freqs);
+        return h->disp != NULL;
+    }
+    if (h->old != NULL) {
+        htable_rehash(h, 1);
+    }
+    /* h keeps its hash function and capacity until a hash is found, so
+       it still works as it did if none is */
+    for (i = 0, j = 0; i < h->capacity; i++) {
+        if (htable_key(h, i) != NULL) {
+            /* inline words need a copy that outlives the slots */
+            words[j] = h->slots != NULL && h->slots[i].len < INLINE_KEY
+                ? arena_strdup(h->strings, htable_key(h, i)) : htable_key(h, i);
+            freqs[j] = htable_freq(h, i);
+            hashes[j] = htable_wide(words[j]);
+            j++;
+        }
+    }
+    h->num_buckets = (n + FREEZE_LAMBDA - 1) / FREEZE_LAMBDA;
+    if (h->num_buckets == 0) {
+        h->num_buckets = 1;
+    }
+    h->num_slots = (int) (n / FREEZE_ALPHA) + 1;
+    num_words = (h->num_slots + 63) / 64;
+    h->disp = emalloc(h->num_buckets * sizeof h->disp[0]);
+    h->ranks = emalloc(num_words * sizeof h->ranks[0]);
+    for (attempt = 0; attempt < FREEZE_SEEDS && !ok; attempt++) {
+        h->seed = htable_mix(attempt + 1);
+        memset(h->ranks, 0, num_words * sizeof h->ranks[0]);
+        ok = htable_displace(h, hashes, n, h->disp, order, h->ranks);
+    }
+    if (!ok) {
+        free(h->disp);
+        free(h->ranks);
+        h->disp = NULL;
+        h->ranks = NULL;
+        h->num_buckets = 0;
+        h->num_slots = 0;
+        h->seed = 0;
+        free(hashes);
+        free(order);
+        free(words);
+        free(freqs);
+        return 0;
+    }
+
+    keys = emalloc((n > 0 ? n : 1) * sizeof keys[0]);
+    keys[0] = NULL;
+    for (i = 0, rank = 0; i < num_words; i++) {
+        h->ranks[i].rank = rank;
+        rank += htable_count_bits(h->ranks[i].used);
+    }
+    for (i = 0; i < n; i++) {
+        j = htable_frozen_index(h, htable_frozen_slot(h, hashes[i],
+                                                      h->disp[htable_frozen_bucket(h, hashes[i])]));
+        keys[j] = words[i];
+        order[j] = freqs[i];
+    }
+    free(h->keys);
+    free(h->freqs);
+    free(h->slots);
+    free(h->tags);
+    free(h->dists);
+    if (h->filter != NULL) {
+        bloom_free(h->filter);
+    }
+    h->hash_fn = WIDE_F;
+    htable_set_capacity(h, n > 0 ? n : 1);
+    h->slots = NULL;
+    h->keys = keys;
+    h->freqs = order;
+    h->tags = NULL;
+    h->dists = NULL;
+    h->filter = NULL;
+    h->max_load = 0.0;
+    h->stats = erealloc(h->stats, (n > 0 ? n : 1) * sizeof h->stats[0]);
+    free(hashes);
+    free(words);
+    free(freqs);
+    return 1;
+}
+
+/*
+ * INLINE_P version of htable_add_probe.
+ * @param h hashtable using INLINE_P
+ * @param str the word we are adding
+ * @param key hash of str from htable_hash
+ * @param count how many times to count the word
+ * @param coll set to the number of collisions it took
+ * @return frequency of the word, or 0 if the table is full
+ */
+
+static int htable_add_inline(htable h, char *str, uint64_t key, int count, int *coll) {
+    int len = strlen(str);
+    int index;
+
+    if (h->old != NULL) {
+        htable_rehash(h, 0);
+        if ((index = htable_find_old(h, str, key, coll)) != -1) {
+            return h->old->slots[index].freq += count;
+        }
+    }
+    index = htable_find_inline(h, str, len, key, coll);
+    if (index != -1 && h->slots[index].freq != 0) {
+        return h->slots[index].freq += count;
+    }
+    if (h->max_load > 0.0 && h->num_keys + 1 > h->max_load * h->capacity) {
+        htable_resize(h, h->mask != 0 ? 2 * h->capacity
+                      : htable_next_prime(2 * h->capacity));
+        index = htable_find_inline(h, str, len, key, coll);
+    }
+    if (index == -1) {
+        return 0;
+    }
+    htable_fill_inline(h, index, str, len, NULL, count);
+    if (h->filter != NULL) {
+        bloom_add(h->filter, key);
+    }
+    h->stats[h->num_keys] = *coll;
+    h->num_keys++;
+    return count;
+}
+
+/*
+ * Adds count to the frequency of a word, inserting it if it is not
+ * already in the hashtable.
+ * @param h hashtable we are adding to
+ * @param str the word we are adding
+ * @param key hash of str from htable_hash
+ * @param count how many times to count the word
+ * @param coll set to the number of collisions it took
+ * @return frequency of the word, or 0 if the table is full
+ */
+
+static int htable_add_probe(htable h, char *str, uint64_t key, int count, int *coll) {
+    int index;
+
+    if (h->map != NULL || h->disp != NULL) {
+        return 0;
+    }
+    if (h->slots != NULL) {
+        return htable_add_inline(h, str, key, count, coll);
+    }
+    if (h->old != NULL) {
+        htable_rehash(h, 0);
+        if ((index = htable_find_old(h, str, key, coll)) != -1) {
+            return h->old->freqs[index] += count;
+        }
+    }
+    index = htable_find(h, str, key, coll);
+    if (index != -1 && h->keys[index] != NULL) {
+        return h->freqs[index] += count;
+    }
+    if (h->max_load > 0.0 && (h->num_keys + 1 > h->max_load * h->capacity
+                              || (h->method == CUCKOO_H && h->stash_used == STASH_SIZE))) {
+        htable_resize(h, h->method == CUCKOO_H
+                      ? htable_cuckoo_capacity(2 * (h->capacity - STASH_SIZE))
+                      : h->mask != 0 ? 2 * h->capacity
+                      : htable_next_prime(2 * h->capacity));
+        index = htable_find(h, str, key, coll);
+    }
+    if (h->method == CUCKOO_H) {
+        if (h->stash_used == STASH_SIZE) {
+            return 0;
+        }
+        *coll = htable_cuckoo_place(h, arena_strdup(h->strings, str), key, count);
+    } else if (h->method == ROBIN_H) {
+        if (h->num_keys >= h->capacity) {
+            return 0;
+        }
+        *coll = htable_robin_place(h, arena_strdup(h->strings, str), key, count);
+    } else if (index == -1) {
+        return 0;
+    } else {
+        htable_fill(h, index, arena_strdup(h->strings, str), key, count);
+    }
+    if (h->filter != NULL) {
+        bloom_add(h->filter, key);
+    }
+    h->stats[h->num_keys] = *coll;
+    h->num_keys++;
+    return count;
+}
+
+#ifndef HTABLE_NO_INSTRUMENT
+
+/*
+ * Reads a clock for timing operations: the time stamp counter where
+ * there is one, or else the monotonic clock in nanoseconds.
+ * @return the current time
+ */
+
+static uint64_t htable_clock(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000u + now.tv_nsec;
+#endif
+}
+
+/*
+ * Starts an operation on h, reading the clock if it is one of the
+ * operations that get timed.
+ * @param h hashtable the operation is on
+ * @return value of htable_clock, or 0 if the operation is not timed
+ */
+
+static uint64_t htable_start_op(htable h) {
+    struct htable_counters *c = h->counters;
+
+    if (--c->until_clock > 0) {
+        return 0;
+    }
+    c->until_clock = CLOCK_SAMPLE;
+    return htable_clock();
+}
+
+/*
+ * Records one finished operation in the counters of h.
+ * @param h hashtable the operation was on
+ * @param op which kind of operation it was
+ * @param coll number of collisions it took
+ * @param strcmps value of h->counters->strcmps when it started
+ * @param start value of htable_start_op when it started
+ */
+
+static void htable_count_op(htable h, enum htable_op op, int coll, long strcmps,
+                            uint64_t start) {
+    struct htable_counters *c = h->counters;
+    unsigned int probes = coll + 1;
+    int bucket = 0, i;
+
+    if (start != 0) {
+        c->op_clock[op] += htable_clock() - start;
+        c->timed[op]++;
+    }
+    c->op_strcmps[op] += c->strcmps - strcmps;
+    while (probes >>= 1) {
+        bucket++;
+    }
+    c->probes[op][bucket]++;
+    c->ops[op]++;
+    if (op == OP_INSERT && --c->until_sample == 0) {
+        if (c->num_samples == LOAD_SAMPLES) {
+            for (i = 0; i < LOAD_SAMPLES / 2; i++) {
+                c->sample_ops[i] = c->sample_ops[2 * i + 1];
+                c->sample_load[i] = c->sample_load[2 * i + 1];
+            }
+            c->num_samples = LOAD_SAMPLES / 2;
+            c->sample_every *= 2;
+        }
+        c->sample_ops[c->num_samples] = c->ops[op];
+        c->sample_load[c->num_samples++] = (double) h->num_keys / h->capacity;
+        c->until_sample = c->sample_every;
+    }
+}
+
+#endif
+
+/*
+ * Adds count to the frequency of a word, inserting it if it is not
+ * already in the hashtable, and counts the insert.
+ * @param h hashtable we are adding to
+ * @param str the word we are adding
+ * @param key hash of str from htable_hash
+ * @param count how many times to count the word
+ * @return frequency of the word, or 0 if the table is full
+ */
+
+static int htable_add(htable h, char *str, uint64_t key, int count) {
+    int coll = 0, result;
+#ifndef HTABLE_NO_INSTRUMENT
+    uint64_t start = htable_start_op(h);
+    long strcmps = h->counters->strcmps;
+
+    result = htable_add_probe(h, str, key, count, &coll);
+    htable_count_op(h, OP_INSERT, coll, strcmps, start);
+#else
+    result = htable_add_probe(h, str, key, count, &coll);
+#endif
+    return result;
+}
+
+/*
+ * Inserts a word into the hashtable or increases the frequency of
+ * the word if it is already in the hashtable. And keeps track of the
+ * number of keys/words in the hashtable.
+ * @param h hashtable we are inserting into
+ * @param str the word we are inserting
+ * @return frequency of the word, or 0 if the table is full
+ */
+
+int htable_insert(htable h, char *str) {
+    return htable_add(h, str, htable_hash(h, str), 1);
+}
+
+/*
+ * Adds every word in src to dest, along with its frequency, so dest
+ * ends up counting the words of both tables. src is not changed.
+ * @param dest hashtable to add the words to
+ * @param src hashtable to take the words from
+ */
+
+void htable_merge(htable dest, htable src) {
+    char *key;
+    int i;
+
+    if (src->old != NULL) {
+        for (i = src->rehash_pos; i < src->old->capacity; i++) {
+            if ((key = htable_key(src->old, i)) != NULL) {
+                htable_add(dest, key, htable_hash(dest, key), htable_freq(src->old, i));
+            }
+        }
+    }
+    for (i = 0; i < src->capacity; i++) {
+        if ((key = htable_key(src, i)) != NULL) {
+            htable_add(dest, key, htable_hash(dest, key), htable_freq(src, i));
+        }
+    }
+}
+
+/*
+ * Looks up a word in a table opened by htable_open_mapped. Every
+ * method but DOUBLE_H and CUCKOO_H keeps a word somewhere in the run
+ * of slots that starts at its home, so those are searched by linear
+ * probing.
+ * @param h mapped hashtable to search
+ * @param str word to look for
+ * @param key hash of str from htable_hash
+ * @param coll set to the number of collisions along the way
+ * @return frequence of str in hashtable
+ */
+
+static int htable_lookup_mapped(htable h, char *str, uint64_t key, int *coll) {
+    unsigned int index = htable_home(h, key);
+    unsigned int step = (h->method == DOUBLE_H) ? htable_step(h, key) : 1;
+    int found;
+
+    if (h->method == CUCKOO_H) {
+        found = htable_find_cuckoo(h, str, key, coll);
+        return found == -1 ? 0 : h->freqs[found];
+    }
+    for (*coll = 0; *coll < h->capacity; (*coll)++) {
+        if (h->offsets[index] == SNAPSHOT_EMPTY) {
+            return 0;
+        }
+        if (h->offsets[index] != SNAPSHOT_DELETED
+            && htable_keycmp(h, h->pool + h->offsets[index] - 1, str) == 0) {
+            return h->freqs[index];
+        }
+        index = htable_wrap(h, index + step);
+    }
+    return 0;
+}
+
+/*
+ * Looks up a word that has already been hashed.
+ * @param h hashtable to search
+ * @param str word to look for
+ * @param key hash of str from htable_hash
+ * @param coll set to the number of collisions along the way
+ * @return frequence of str in hashtable
+ */
+
+static int htable_lookup_probe(htable h, char *str, uint64_t key, int *coll) {
+    int index;
+
+    if (h->disp != NULL) {
+        index = htable_frozen_index(h, htable_frozen_slot(h, key,
+                                                          h->disp[htable_frozen_bucket(h, key)]));
+        *coll = 0;
+        if (index < 0 || htable_keycmp(h, h->keys[index], str) != 0) {
+            return 0;
+        }
+        return h->freqs[index];
+    }
+    if (h->map != NULL) {
+        return htable_lookup_mapped(h, str, key, coll);
+    }
+    if (h->filter != NULL && !bloom_maybe(h->filter, key)
+        && (h->old == NULL || !bloom_maybe(h->old->filter, key))) {
+        *coll = 0;
+        h->filter_rejects++;
+        return 0;
+    }
+    if ((index = htable_find_old(h, str, key, coll)) != -1) {
+        return htable_freq(h->old, index);
+    } else if (h->slots != NULL) {
+        index = htable_find_inline(h, str, strlen(str), key, coll);
+        if (index != -1 && h->slots[index].freq != 0) {
+            return h->slots[index].freq;
+        }
+    } else if ((index = htable_find(h, str, key, coll)) != -1 && h->keys[index] != NULL) {
+        return h->freqs[index];
+    }
+    if (h->filter != NULL) {
+        h->filter_false++;
+    }
+    return 0;
+}
+
+/*
+ * Looks up a word that has already been hashed, and counts the
+ * search as a hit or a miss.
+ * @param h hashtable to search
+ * @param str word to look for
+ * @param key hash of str from htable_hash
+ * @return frequence of str in hashtable
+ */
+
+static int htable_lookup(htable h, char *str, uint64_t key) {
+    int coll = 0, result;
+#ifndef HTABLE_NO_INSTRUMENT
+    uint64_t start = htable_start_op(h);
+    long strcmps = h->counters->strcmps;
+
+    result = htable_lookup_probe(h, str, key, &coll);
+    htable_count_op(h, result > 0 ? OP_HIT : OP_MISS, coll, strcmps, start);
+#else
+    result = htable_lookup_probe(h, str, key, &coll);
+#endif
+    return result;
+}
+
+/*
+ * Checks whether a slot is cyclically after from and no further along
+ * than to.
+ */
+
+static int htable_between(int from, int index, int to) {
+    return from <= to ? from < index && index <= to
+        : from < index || index <= to;
+}
+
+/*
+ * Empties a slot of a LINEAR_P table, then moves back any key further
+ * along the run that can no longer be reached from its home slot.
+ * Knuth's Algorithm R; no tombstone is needed.
+ * @param h hashtable using LINEAR_P
+ * @param index slot to empty
+ * @param stop the run is not followed around the end of the table into
+ * the slots below stop
+ */
+
+static void htable_shift_back(htable h, int index, int stop) {
+    int next = htable_wrap(h, index + 1);
+    int home;
+
+    h->keys[index] = NULL;
+    h->freqs[index] = 0;
+    while (next >= stop && h->keys[next] != NULL) {
+        home = htable_home(h, htable_hash(h, h->keys[next]));
+        if (!htable_between(index, home, next)) {
+            h->keys[index] = h->keys[next];
+            h->freqs[index] = h->freqs[next];
+            h->keys[next] = NULL;
+            h->freqs[next] = 0;
+            index = next;
+        }
+        next = htable_wrap(h, next + 1);
+    }
+}
+
+/*
+ * INLINE_P version of htable_shift_back.
+ * @param h hashtable using INLINE_P
+ * @param index slot to empty
+ * @param stop the run is not followed around the end of the table into
+ * the slots below stop
+ */
+
+static void htable_inline_shift_back(htable h, int index, int stop) {
+    int next = htable_wrap(h, index + 1);
+    int home;
+
+    h->slots[index].freq = 0;
+    while (next >= stop && h->slots[next].freq != 0) {
+        home = htable_home(h, htable_hash(h, htable_key(h, next)));
+        if (!htable_between(index, home, next)) {
+            h->slots[index] = h->slots[next];
+            h->slots[next].freq = 0;
+            index = next;
+        }
+        next = htable_wrap(h, next + 1);
+    }
+}
+
+/*
+ * Empties a slot of a ROBIN_H table. The keys after it in the same
+ * run are shifted back one slot, each one getting a step closer to
+ * home.
+ * @param h hashtable using ROBIN_H
+ * @param index slot to empty
+ * @param stop the run is not followed around the end of the table into
+ * the slots below stop
+ */
+
+static void htable_robin_shift_back(htable h, int index, int stop) {
+    int next = htable_wrap(h, index + 1);
+
+    while (next >= stop && h->keys[next] != NULL && h->dists[next] > 0) {
+        h->keys[index] = h->keys[next];
+        h->freqs[index] = h->freqs[next];
+        h->dists[index] = h->dists[next] - 1;
+        index = next;
+        next = htable_wrap(h, next + 1);
+    }
+    h->keys[index] = NULL;
+    h->freqs[index] = 0;
+}
+
+/*
+ * Removes a word from the part of h->old that has not been moved yet,
+ * the way htable_remove would. The slots below h->rehash_pos hold
+ * words that have been moved already, so a run is not shifted back
+ * over them, which would move those words a second time. Tombstones
+ * are not counted, as h->old is freed once it is drained.
+ * @param h hashtable part way through a rehash
+ * @param index slot of the word in h->old, from htable_find_old
+ */
+
+static void htable_remove_old(htable h, int index) {
+    htable old = h->old;
+
+    switch (old->method) {
+        case LINEAR_P:
+            htable_shift_back(old, index, h->rehash_pos);
+            break;
+        case INLINE_P:
+            htable_inline_shift_back(old, index, h->rehash_pos);
+            break;
+        case ROBIN_H:
+            htable_robin_shift_back(old, index, h->rehash_pos);
+            break;
+        case CUCKOO_H:
+            old->keys[index] = NULL;
+            old->freqs[index] = 0;
+            break;
+        default:
+            old->keys[index] = NULL;
+            old->freqs[index] = DELETED;
+            if (old->method == SWISS_P) {
+                htable_set_tag(old, index, DELETED_TAG);
+            }
+            break;
+    }
+}
+
+/*
+ * Removes a word from the hashtable. LINEAR_P, INLINE_P and ROBIN_H shift the
+ * rest of the run back over the gap, and CUCKOO_H just empties the
+ * slot. DOUBLE_H and SWISS_P leave a
+ * tombstone, and once tombstones fill half of the slots that hold no
+ * word the table is rebuilt without them, so searches do not get
+ * slower the more words come and go.
+ * @param h hashtable to remove from
+ * @param str the word to remove
+ * @return 1 if str was removed, or 0 if it was not in the table
+ */
+
+int htable_remove(htable h, char *str) {
+    uint64_t key = htable_hash(h, str);
+    int coll, index;
+
+    if (h->map != NULL || h->disp != NULL) {
+        return 0;
+    }
+    if ((index = htable_find_old(h, str, key, &coll)) != -1) {
+        h->num_keys--;
+        htable_remove_old(h, index);
+        return 1;
+    }
+    if (h->slots != NULL) {
+        index = htable_find_inline(h, str, strlen(str), key, &coll);
+        if (index == -1 || h->slots[index].freq == 0) {
+            return 0;
+        }
+        h->num_keys--;
+        htable_inline_shift_back(h, index, 0);
+        return 1;
+    }
+    index = htable_find(h, str, key, &coll);
+    if (index == -1 || h->keys[index] == NULL) {
+        return 0;
+    }
+    /* the key's bytes stay in h->strings until htable_free */
+    h->num_keys--;
+    switch (h->method) {
+        case LINEAR_P:
+            htable_shift_back(h, index, 0);
+            break;
+        case ROBIN_H:
+            htable_robin_shift_back(h, index, 0);
+            break;
+        case CUCKOO_H:
+            /* nothing probes past a CUCKOO_H slot, so just empty it */
+            h->keys[index] = NULL;
+            h->freqs[index] = 0;
+            if (index >= h->capacity - STASH_SIZE) {
+                h->stash_used--;
+            }
+            break;
+        default:
+            h->keys[index] = NULL;
+            h->freqs[index] = DELETED;
+            if (h->method == SWISS_P) {
+                htable_set_tag(h, index, DELETED_TAG);
+            }
+            if (++h->tombstones * 2 >= h->capacity - h->num_keys) {
+                htable_resize(h, h->capacity);
+                htable_rehash(h, 1);
+            }
+            break;
+    }
+    return 1;
+}
+
+/*
+ * Decreases the frequency of a word by one, removing it once its
+ * frequency reaches zero.
+ * @param h hashtable holding the word
+ * @param str the word to decrement
+ * @return the new frequency of the word, which is 0 if it has been
+ * removed or was not in the table
+ */
+
+int htable_decrement(htable h, char *str) {
+    uint64_t key = htable_hash(h, str);
+    int coll, index;
+
+    if (h->map != NULL || h->disp != NULL) {
+        return 0;
+    }
+    if ((index = htable_find_old(h, str, key, &coll)) != -1) {
+        if (htable_freq(h->old, index) > 1) {
+            return h->old->slots != NULL ? --h->old->slots[index].freq
+                : --h->old->freqs[index];
+        }
+    } else if (h->slots != NULL) {
+        index = htable_find_inline(h, str, strlen(str), key, &coll);
+        if (index == -1 || h->slots[index].freq == 0) {
+            return 0;
+        }
+        if (h->slots[index].freq > 1) {
+            return --h->slots[index].freq;
+        }
+        htable_remove(h, str);
+        return 0;
+    }
+    if (index == -1) {
+        index = htable_find(h, str, key, &coll);
+        if (index == -1 || h->keys[index] == NULL) {
+            return 0;
+        }
+        if (h->freqs[index] > 1) {
+            return --h->freqs[index];
+        }
+    }
+    htable_remove(h, str);
+    return 0;
+}
+
+/*
+ * Searches the hashtable for a given word.
+ * @param h hashtable to search
+ * @param str word to look for
+ * @return frequence of str in hashtable
+ */
+
+int htable_search(htable h, char *str) {
+    return htable_lookup(h, str, htable_hash(h, str));
+}
+
+/*
+ * Hashes up to BATCH_SIZE words and asks for the cache lines they will
+ * probe first, without waiting for any of them. The home slots are
+ * fetched, then the keys already sitting in them. For a frozen table
+ * the displacements are fetched, then the ranks of the slots they
+ * lead to.
+ * @param h hashtable the words are for
+ * @param words the words to hash
+ * @param n number of words, at most BATCH_SIZE
+ * @param keys set to the hash of each word
+ */
+
+static void htable_prefetch(htable h, char **words, int n, uint64_t *keys) {
+    unsigned int home[BATCH_SIZE];
+    int i;
+
+    for (i = 0; i < n; i++) {
+        keys[i] = htable_hash(h, words[i]);
+        if (h->disp != NULL) {
+            /* the slot depends on the displacement, fetched first */
+            home[i] = htable_frozen_bucket(h, keys[i]);
+            PREFETCH(&h->disp[home[i]]);
+            continue;
+        }
+        if (h->method == CUCKOO_H) {
+            home[i] = htable_bucket(h, keys[i], 0);
+            PREFETCH(h->map != NULL ? (void *) &h->offsets[htable_bucket(h, keys[i], 1)]
+                     : (void *) &h->keys[htable_bucket(h, keys[i], 1)]);
+        } else {
+            home[i] = htable_home(h, keys[i]);
+        }
+        if (h->map != NULL) {
+            PREFETCH(&h->offsets[home[i]]);
+        } else if (h->slots != NULL) {
+            PREFETCH(&h->slots[home[i]]);
+        } else {
+            PREFETCH(&h->keys[home[i]]);
+        }
+        if (h->tags != NULL) {
+            PREFETCH(&h->tags[home[i]]);
+        }
+    }
+    for (i = 0; i < n; i++) {
+        if (h->disp != NULL) {
+            home[i] = htable_frozen_slot(h, keys[i], h->disp[home[i]]);
+            PREFETCH(&h->ranks[home[i] / 64]);
+            continue;
+        }
+        if (h->slots != NULL) {
+            /* the word and its frequency are in the slot already */
+            continue;
+        }
+        if (htable_key(h, home[i]) != NULL) {
+            PREFETCH(htable_key(h, home[i]));
+        }
+        PREFETCH(&h->freqs[home[i]]);
+    }
+}
+
+/*
+ * Inserts an array of words, in order, just as htable_insert would.
+ * Words are hashed and their slots fetched a batch at a time before
+ * any probing is done, so the table can be waiting on several cache
+ * misses at once instead of one after another.
+ * @param h hashtable we are inserting into
+ * @param words the words we are inserting
+ * @param n number of words
+ * @return number of words that were counted, which is less than n
+ * only if the table filled up
+ */
+
+int htable_insert_batch(htable h, char **words, int n) {
+    uint64_t keys[BATCH_SIZE];
+    int i, j, size, inserted = 0;
+
+    for (i = 0; i < n; i += BATCH_SIZE) {
+        size = n - i < BATCH_SIZE ? n - i : BATCH_SIZE;
+        htable_prefetch(h, words + i, size, keys);
+        for (j = 0; j < size; j++) {
+            if (htable_add(h, words[i + j], keys[j], 1) != 0) {
+                inserted++;
+            }
+        }
+    }
+    return inserted;
+}
+
+/*
+ * Searches for an array of words, overlapping their cache misses in
+ * the same way as htable_insert_batch.
+ * @param h hashtable to search
+ * @param words the words to look for
+ * @param n number of words
+ * @param freqs set to the frequency of each word in the table
+ */
+
+void htable_search_batch(htable h, char **words, int n, int *freqs) {
+    uint64_t keys[BATCH_SIZE];
+    int i, j, size;
+
+    for (i = 0; i < n; i += BATCH_SIZE) {
+        size = n - i < BATCH_SIZE ? n - i : BATCH_SIZE;
+        htable_prefetch(h, words + i, size, keys);
+        for (j = 0; j < size; j++) {
+            freqs[i + j] = htable_lookup(h, words[i + j], keys[j]);
+        }
+    }
+}
+
+/*
+ * passed into htable_print
+ * @param freq frequency of word
+ * @param word the word we want information about
+
+ static void print_info(int freq, char *word) {
+ printf("%-4d %s\n", freq, word);
+ }
+*/
+
+/*
+ * prints the frequency and keys in the hashtable
+ * @param h hashtable we want to print
+ */
+
+void htable_print(htable h, void p(int freq, char *word)) {
+    char *key;
+    int i;
+    if (h->old != NULL) {
+        htable_rehash(h, 1);
+    }
+    for (i=0; i < h->capacity; i++) {
+        if ((key = htable_key(h, i)) != NULL) {
+            p(htable_freq(h, i), key);
+        }
+    }
+}
+
+/*
+ * A word and its frequency, as kept in the heap used by htable_top_k.
+ */
+
+struct top_entry {
+    int freq;
+    char *key;
+};
+
+/*
+ * Orders words by frequency, with ties going to the word that comes
+ * first alphabetically.
+ * @return nonzero if a ranks below b
+ */
+
+static int top_below(struct top_entry *a, struct top_entry *b) {
+    return a->freq != b->freq ? a->freq < b->freq : strcmp(a->key, b->key) > 0;
+}
+
+/*
+ * Moves the entry at index down the min-heap until neither child
+ * ranks below it.
+ * @param heap the heap
+ * @param size number of entries in the heap
+ * @param index the entry to move
+ */
+
+static void top_sift_down(struct top_entry *heap, int size, int index) {
+    struct top_entry tmp;
+    int child;
+
+    while ((child = 2 * index + 1) < size) {
+        if (child + 1 < size && top_below(&heap[child + 1], &heap[child])) {
+            child++;
+        }
+        if (!top_below(&heap[child], &heap[index])) {
+            return;
+        }
+        tmp = heap[index];
+        heap[index] = heap[child];
+        heap[child] = tmp;
+        index = child;
+    }
+}
+
+/*
+ * Offers a word to a min-heap of the best size words seen so far.
+ * @param heap the heap, with room for k entries
+ * @param size number of entries in the heap, updated
+ * @param k most entries the heap may hold
+ * @param freq frequency of the word
+ * @param key the word
+ */
+
+static void top_offer(struct top_entry *heap, int *size, int k, int freq, char *key) {
+    struct top_entry entry, tmp;
+    int index, parent;
+
+    entry.freq = freq;
+    entry.key = key;
+    if (*size < k) {
+        index = (*size)++;
+        heap[index] = entry;
+        while (index > 0 && top_below(&heap[index], &heap[parent = (index - 1) / 2])) {
+            tmp = heap[index];
+            heap[index] = heap[parent];
+            heap[parent] = tmp;
+            index = parent;
+        }
+    } else if (top_below(&heap[0], &entry)) {
+        heap[0] = entry;
+        top_sift_down(heap, *size, 0);
+    }
+}
+
+/*
+ * Finds the k most frequent words without sorting the whole table.
+ * A min-heap of the best k words so far is kept while scanning the
+ * frequencies, which takes O(capacity log k) time and O(k) memory.
+ * @param h hashtable to look through
+ * @param k how many words to find
+ * @param p function called with each word, most frequent first
+ */
+
+void htable_top_k(htable h, int k, void p(int freq, char *word)) {
+    struct top_entry *heap, tmp;
+    char *key;
+    int i, size = 0;
+
+    if (k > h->num_keys) {
+        k = h->num_keys;
+    }
+    if (k < 1) {
+        return;
+    }
+    heap = emalloc(k * sizeof heap[0]);
+    if (h->old != NULL) {
+        for (i = h->rehash_pos; i < h->old->capacity; i++) {
+            if ((key = htable_key(h->old, i)) != NULL) {
+                top_offer(heap, &size, k, htable_freq(h->old, i), key);
+            }
+        }
+    }
+    for (i = 0; i < h->capacity; i++) {
+        if ((key = htable_key(h, i)) != NULL) {
+            top_offer(heap, &size, k, htable_freq(h, i), key);
+        }
+    }
+    /* taking the lowest off the top leaves the rest in order behind it */
+    for (i = size - 1; i > 0; i--) {
+        tmp = heap[0];
+        heap[0] = heap[i];
+        heap[i] = tmp;
+        top_sift_down(heap, i, 0);
+    }
+    for (i = 0; i < size; i++) {
+        p(heap[i].freq, heap[i].key);
+    }
+    free(heap);
+}
+
+/*
+ * Print out a line of data from the hash table to reflect the state
+ * the table was in when it was a certain percentage full.
+ * @param stream - a stream to print the data to
+ * @param percent_full - the point at which to show the data from.
+ * @param current_entries - how many keys the table held at that point
+ * @param at_home - how many of those keys were placed without a collision
+ * @param total_collisions - collisions while placing those keys
+ * @param max_collisions - most collisions while placing one of them
+ */
+
+static void print_stats_line(FILE *stream, int percent_full, int current_entries,
+                             int at_home, double total_collisions, int max_collisions) {
+    fprintf(stream, "%4d %10d %11.1f %10.2f %11d\n", percent_full,
+            current_entries, at_home * 100.0 / current_entries,
+            total_collisions / current_entries, max_collisions);
+}
+
+/*
+ * Returns the name of a collision resolution strategy.
+ * @param method the strategy
+ * @return name to print at the top of the stats table
+ */
+
+static const char *htable_method_name(hashing_t method) {
+    switch (method) {
+        case LINEAR_P:
+            return "Linear Probing";
+        case DOUBLE_H:
+            return "Double Hashing";
+        case SWISS_P:
+            return "Swiss Table Group Probing";
+        case ROBIN_H:
+            return "Robin Hood Hashing";
+        case CUCKOO_H:
+            return "Cuckoo Hashing";
+        case INLINE_P:
+            return "Linear Probing, Inline Keys";
+    }
+    return "Unknown";
+}
+
+/*
+ * Prints out a table showing what the following attributes were like
+ * at regular intervals (as detemined by num_stats) while the
+ * hashtable was being built.
+ *
+ * @li Percent At Home - how many keys were placed without a collision
+ * occuring
+ * @li Average Collisions - how many collisions have occurred on
+ * average while placing all of the keys so far.
+ * @li Maximum Collisions - the most collisions that have occurred
+ * while placing a key.
+ *
+ * @param h the hashtable to print statistics summary from.
+ * @param stream the stream to send output to.
+ * @param num_stats the maximum number of statistical snapshots to print.
+ */
+
+void htable_print_stats(htable h, FILE *stream, int num_stats) {
+    double total_collisions = 0.0;
+    int at_home = 0, max_collisions = 0;
+    int i, row;
+
+    if (h->hash_fn == WORD_F) {
+        fprintf(stream, "\n%s\n\n", htable_method_name(h->method));
+    } else {
+        fprintf(stream, "\n%s, %s hash\n\n", htable_method_name(h->method),
+                h->hash_fn == FNV1A_F ? "FNV-1a" : "Wide");
+    }
+    fprintf(stream, "Percent   Current    Percent    Average      Maximum\n");
+    fprintf(stream, " Full     Entries    At Home   Collisions   Collisions\n");
+    fprintf(stream, "------------------------------------------------------\n");
+    /* one pass over the stats, printing each row as its prefix ends.
+       Rows for a point the table never reached are left out. */
+    for (row = 1; row <= num_stats && h->capacity * (100 * row / num_stats) / 100 <= 0;
+         row++)
+        ;
+    for (i = 0; i < h->num_keys && row <= num_stats; i++) {
+        if (h->stats[i] == 0) {
+            at_home++;
+        }
+        if (h->stats[i] > max_collisions) {
+            max_collisions = h->stats[i];
+        }
+        total_collisions += h->stats[i];
+        while (row <= num_stats
+               && h->capacity * (100 * row / num_stats) / 100 == i + 1) {
+            print_stats_line(stream, 100 * row / num_stats, i + 1, at_home,
+                             total_collisions, max_collisions);
+            row++;
+        }
+    }
+    fprintf(stream, "------------------------------------------------------\n\n");
+    if (h->method == ROBIN_H) {
+        /* keys are pushed along after they are placed */
+        fprintf(stream, "Maximum displacement: %d\n\n", h->max_dist);
+    }
+    if (h->method == CUCKOO_H) {
+        /* the collisions above are how many words each insert moved */
+        fprintf(stream, "Words moved: %ld, longest chain: %d\n", h->kicks, h->max_dist);
+        if (h->stash_load > 0.0) {
+            fprintf(stream, "Stash: %d of %d slots in use, first needed at %.1f%% full\n",
+                    h->stash_used, STASH_SIZE, 100.0 * h->stash_load);
+        } else {
+            fprintf(stream, "Stash: never needed, up to %.1f%% full\n",
+                    100.0 * h->num_keys / h->capacity);
+        }
+#ifndef HTABLE_NO_INSTRUMENT
+        if (h->counters->op_clock[OP_INSERT] > 0) {
+#if defined(__x86_64__) || defined(__i386__)
+            fprintf(stream, "Insert throughput: %.0f inserts per million TSC cycles\n",
+#else
+            fprintf(stream, "Insert throughput: %.0f inserts per millisecond\n",
+#endif
+                    1e6 * h->counters->timed[OP_INSERT] / h->counters->op_clock[OP_INSERT]);
+        }
+#endif
+        fprintf(stream, "\n");
+    }
+    if (h->disp != NULL) {
+        fprintf(stream, "Frozen: %d words in %d buckets and %d slots, %lu bytes of "
+                "words, displacements and ranks\n\n", h->num_keys, h->num_buckets,
+                h->num_slots,
+                (unsigned long) (h->capacity * (sizeof h->keys[0] + sizeof h->freqs[0])
+                                 + h->num_buckets * sizeof h->disp[0]
+                                 + (h->num_slots + 63) / 64 * sizeof h->ranks[0]));
+    }
+    if (h->filter != NULL) {
+        /* of the searches for words not in the table, how many got
+           past the filter */
+        fprintf(stream, "Bloom filter: %ld misses rejected, %ld false positives"
+                " (%.2f%%)\n\n", h->filter_rejects, h->filter_false,
+                h->filter_rejects + h->filter_false == 0 ? 0.0
+                : 100.0 * h->filter_false / (h->filter_rejects + h->filter_false));
+    }
+}
+
+#ifndef HTABLE_NO_INSTRUMENT
+
+/*
+ * Writes the counters for one kind of operation as a JSON object.
+ * @param c the counters
+ * @param op which kind of operation
+ * @param stream the stream to send output to
+ */
+
+static void print_op_json(struct htable_counters *c, enum htable_op op, FILE *stream) {
+    int i, last;
+
+    for (last = HIST_BUCKETS - 1; last > 0 && c->probes[op][last] == 0; last--)
+        ;
+    fprintf(stream, "{\"count\": %ld, \"strcmp_per_op\": %.3f, \"clock_per_op\": %.1f, "
+            "\"probe_histogram\": [", c->ops[op],
+            c->ops[op] ? (double) c->op_strcmps[op] / c->ops[op] : 0.0,
+            c->timed[op] ? (double) c->op_clock[op] / c->timed[op] : 0.0);
+    for (i = 0; i <= last; i++) {
+        fprintf(stream, "%s[%lu, %ld]", i ? ", " : "", 1lu << i, c->probes[op][i]);
+    }
+    fprintf(stream, "]}");
+}
+
+#endif
+
+/*
+ * Writes statistics about the hashtable as a single JSON object, for
+ * other programs to read. Along with the size of the table it gives,
+ * for inserts and for searches that hit and that missed: how many
+ * there were, strcmp calls and clock ticks per operation (from the
+ * one operation in CLOCK_SAMPLE that is timed), and a
+ * histogram of probe lengths as [lowest length, count] pairs. The
+ * load factor sampled over the inserts is given as [insert, load]
+ * pairs. Ticks are TSC cycles on x86 ("clock": "tsc") and nanoseconds
+ * elsewhere ("clock": "ns"). A table with a Bloom filter also gives
+ * how many misses the filter turned away and how many it let through.
+ * Built with HTABLE_NO_INSTRUMENT, only the size of the table and the
+ * filter counts are given.
+ * @param h the hashtable to print statistics from
+ * @param stream the stream to send output to
+ */
+
+void htable_print_stats_json(htable h, FILE *stream) {
+#ifndef HTABLE_NO_INSTRUMENT
+    struct htable_counters *c = h->counters;
+    int i;
+#endif
+
+    fprintf(stream, "{\"method\": \"%s\", \"hash\": \"%s\", \"capacity\": %d, "
+            "\"keys\": %d, \"load\": %.4f, ", htable_method_name(h->method),
+            h->hash_fn == WORD_F ? "word" : h->hash_fn == FNV1A_F ? "fnv" : "wide",
+            h->capacity, h->num_keys, (double) h->num_keys / h->capacity);
+    if (h->disp != NULL) {
+        fprintf(stream, "\"frozen_buckets\": %d, \"frozen_slots\": %d, ", h->num_buckets,
+                h->num_slots);
+    }
+    if (h->method == CUCKOO_H) {
+        fprintf(stream, "\"moved\": %ld, \"longest_chain\": %d, \"stash_used\": %d, "
+                "\"stash_first_load\": %.4f, ", h->kicks, h->max_dist, h->stash_used,
+                h->stash_load);
+    }
+    if (h->filter != NULL) {
+        fprintf(stream, "\"filter\": {\"rejected\": %ld, \"false_positives\": %ld, "
+                "\"false_positive_rate\": %.4f}, ", h->filter_rejects, h->filter_false,
+                h->filter_rejects + h->filter_false == 0 ? 0.0
+                : (double) h->filter_false / (h->filter_rejects + h->filter_false));
+    }
+#ifndef HTABLE_NO_INSTRUMENT
+#if defined(__x86_64__) || defined(__i386__)
+    fprintf(stream, "\"instrumented\": true, \"clock\": \"tsc\",\n");
+#else
+    fprintf(stream, "\"instrumented\": true, \"clock\": \"ns\",\n");
+#endif
+    fprintf(stream, " \"insert\": ");
+    print_op_json(c, OP_INSERT, stream);
+    fprintf(stream, ",\n \"search_hit\": ");
+    print_op_json(c, OP_HIT, stream);
+    fprintf(stream, ",\n \"search_miss\": ");
+    print_op_json(c, OP_MISS, stream);
+    fprintf(stream, ",\n \"load_over_time\": [");
+    for (i = 0; i < c->num_samples; i++) {
+        fprintf(stream, "%s[%ld, %.4f]", i ? ", " : "", c->sample_ops[i],
+                c->sample_load[i]);
+    }
+    fprintf(stream, "]}\n");
+#else
+    fprintf(stream, "\"instrumented\": false}\n");
+#endif
+}
+
+/*
+ * Prints the entire hashtable in a readable format
+ * @param h the hashtable we're reading
+ * @param stream the stream to send output to
+ */
+
+void htable_print_entire_table(htable h, FILE *stream) {
+    char *key;
+    int i;
+    if (h->old != NULL) {
+        htable_rehash(h, 1);
+    }
+
+    fprintf(stream, "  Pos  Freq  Stats  Word\n");
+    fprintf(stream, "----------------------------------------\n");
+
+    for (i=0; i < h->capacity; i++) {
+        if ((key = htable_key(h, i)) != NULL) {
+            fprintf(stream, "%5d %5d %5d   %s\n", i, htable_freq(h, i), h->stats[i], key);
+        }
+        else {
+            fprintf(stream, "%5d %5d %5d   \n", i, htable_freq(h, i), h->stats[i]);
+        }
+    }
+}
+
+/*
+ * Writes the hashtable to a stream as a snapshot that
+ * htable_open_mapped can use in place, without rebuilding the table.
+ * @param h hashtable to save
+ * @param stream the stream to write the snapshot to
+ * @return 1 on success, or 0 if the snapshot could not be written or
+ * the table is frozen
+ */
+
+int htable_save(htable h, FILE *stream) {
+    struct snapshot_header header;
+    uint32_t offset = 0, slot;
+    char *key;
+    int i;
+
+    if (h->disp != NULL) {
+        return 0;
+    }
+    if (h->old != NULL) {
+        htable_rehash(h, 1);
+    }
+    memset(&header, 0, sizeof header);
+    strcpy(header.magic, SNAPSHOT_MAGIC);
+    header.capacity = h->capacity;
+    header.num_keys = h->num_keys;
+    header.method = h->method;
+    header.hash_fn = h->hash_fn;
+    header.max_dist = h->max_dist;
+    header.tombstones = h->tombstones;
+    for (i = 0; i < h->capacity; i++) {
+        if ((key = htable_key(h, i)) != NULL) {
+            header.pool_size += strlen(key) + 1;
+        }
+    }
+    if (fwrite(&header, sizeof header, 1, stream) != 1) {
+        return 0;
+    }
+    for (i = 0; i < h->capacity; i++) {
+        if ((key = htable_key(h, i)) != NULL) {
+            slot = offset + 1;
+            offset += strlen(key) + 1;
+        } else {
+            slot = htable_freq(h, i) == DELETED ? SNAPSHOT_DELETED : SNAPSHOT_EMPTY;
+        }
+        if (fwrite(&slot, sizeof slot, 1, stream) != 1) {
+            return 0;
+        }
+    }
+    for (i = 0; h->slots != NULL && i < h->capacity; i++) {
+        if (fwrite(&h->slots[i].freq, sizeof h->slots[i].freq, 1, stream) != 1) {
+            return 0;
+        }
+    }
+    if ((h->slots == NULL
+         && fwrite(h->freqs, sizeof h->freqs[0], h->capacity, stream) != (size_t) h->capacity)
+        || fwrite(h->stats, sizeof h->stats[0], h->capacity, stream) != (size_t) h->capacity) {
+        return 0;
+    }
+    for (i = 0; i < h->capacity; i++) {
+        if ((key = htable_key(h, i)) != NULL
+            && fwrite(key, 1, strlen(key) + 1, stream) != strlen(key) + 1) {
+            return 0;
+        }
+    }
+    return fflush(stream) == 0;
+}
+
+/*
+ * Checks that a mapped file holds a whole snapshot that searches can
+ * read without going past its end: the header makes sense and matches
+ * the size of the file, every key offset points into the string pool,
+ * and the pool ends with a '\0' so the last key does too.
+ * @param header the start of the mapped file
+ * @param size size of the file
+ * @return 1 if the snapshot can be used, or 0 if not
+ */
+
+static int htable_snapshot_ok(struct snapshot_header *header, size_t size) {
+    size_t cap = header->capacity, i;
+    uint32_t *offsets = (uint32_t *) (header + 1);
+    char *pool;
+
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof header->magic) != 0
+        || header->capacity < 1 || header->num_keys < 0 || header->num_keys > header->capacity
+        || header->method < LINEAR_P || header->method > INLINE_P
+        || header->hash_fn < WORD_F || header->hash_fn > WIDE_F
+        || (header->method == CUCKOO_H && header->capacity < BUCKET_SLOTS + STASH_SIZE)
+        || size != sizeof *header + cap * (sizeof offsets[0] + 2 * sizeof(int))
+        + header->pool_size) {
+        return 0;
+    }
+    pool = (char *) header + size - header->pool_size;
+    if (header->pool_size > 0 && pool[header->pool_size - 1] != '\0') {
+        return 0;
+    }
+    for (i = 0; i < cap; i++) {
+        if (offsets[i] != SNAPSHOT_EMPTY && offsets[i] != SNAPSHOT_DELETED
+            && offsets[i] - 1 >= header->pool_size) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Maps a snapshot written by htable_save into memory and returns a
+ * read-only hashtable that works on it directly. The snapshot is not
+ * copied; only the key offsets are read when it is opened, to check
+ * them, and the rest is read in as searches touch it. htable_insert
+ * and htable_remove do nothing on a mapped table.
+ * @param filename the snapshot file
+ * @return the mapped hashtable, or NULL if the file could not be
+ * mapped or is not a whole snapshot
+ */
+
+htable htable_open_mapped(char *filename) {
+    struct snapshot_header *header;
+    struct stat info;
+    void *map;
+    size_t cap;
+    htable h;
+    int fd;
+
+    if ((fd = open(filename, O_RDONLY)) == -1) {
+        return NULL;
+    }
+    if (fstat(fd, &info) == -1 || (size_t) info.st_size < sizeof *header) {
+        close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    header = map;
+    cap = header->capacity;
+    if (!htable_snapshot_ok(header, info.st_size)) {
+        munmap(map, info.st_size);
+        return NULL;
+    }
+
+    h = emalloc(sizeof *h);
+    h->map = map;
+    h->map_size = info.st_size;
+    h->method = header->method;
+    htable_set_capacity(h, header->capacity);
+    h->num_keys = header->num_keys;
+    h->hash_fn = header->hash_fn;
+    h->max_dist = header->max_dist;
+    h->tombstones = header->tombstones;
+    h->stash_used = 0;
+    h->kicks = 0;
+    h->stash_load = 0.0;
+    h->disp = NULL;
+    h->num_buckets = 0;
+    h->num_slots = 0;
+    h->ranks = NULL;
+    h->seed = 0;
+    h->offsets = (uint32_t *) (header + 1);
+    h->freqs = (int *) (h->offsets + cap);
+    h->stats = h->freqs + cap;
+    h->pool = (char *) (h->stats + cap);
+    h->keys = NULL;
+    h->slots = NULL;
+    h->strings = NULL;
+    h->tags = NULL;
+    h->dists = NULL;
+    h->old = NULL;
+    h->max_load = 0.0;
+    h->rehash_step = 0;
+    h->rehash_pos = 0;
+    h->counters = htable_new_counters();
+    h->filter = NULL;
+    h->filter_rejects = 0;
+    h->filter_false = 0;
+    return h;
 }
@@ -4,14 +4,29 @@
 #include <stdio.h>
 
 typedef struct htablerec *htable;
-typedef enum hashing_e { LINEAR_P, DOUBLE_H } hashing_t;
+typedef enum hashing_e { LINEAR_P, DOUBLE_H, SWISS_P, ROBIN_H, CUCKOO_H,
+                             INLINE_P } hashing_t;
+typedef enum hash_fn_e { WORD_F, FNV1A_F, WIDE_F } hash_fn_t;
 
 extern void   htable_free(htable h);
 extern int    htable_insert(htable h, char *str);
+extern int    htable_insert_batch(htable h, char **words, int n);
+extern void   htable_merge(htable dest, htable src);
 extern htable htable_new(int capacity, hashing_t method);
+extern htable htable_new_hash(int capacity, hashing_t method, hash_fn_t hash_fn);
 extern void   htable_print(htable h, void p(int freq, char *key));
+extern void   htable_top_k(htable h, int k, void p(int freq, char *key));
 extern int    htable_search(htable h, char *str);
+extern void   htable_search_batch(htable h, char **words, int n, int *freqs);
+extern int    htable_remove(htable h, char *str);
+extern int    htable_decrement(htable h, char *str);
 extern void   htable_print_entire_table(htable h, FILE *stream);
 extern void   htable_print_stats(htable h, FILE *stream, int num_stats);
+extern void   htable_print_stats_json(htable h, FILE *stream);
+extern void   htable_set_max_load(htable h, double max_load);
+extern void   htable_use_filter(htable h);
+extern int    htable_freeze(htable h);
+extern int    htable_save(htable h, FILE *stream);
+extern htable htable_open_mapped(char *filename);
 
 #endif
@@ -72,3 +72,41 @@ int getword(char *s, int limit, FILE *stream) {
     *w = '\0';
     return w - s;
 }
+
+/*
+ * Same as getword, but reads from the characters between *pos and end
+ * instead of a file.
+ * @param s pointer to char to store the word in
+ * @param limit max size of the word
+ * @param pos start of the characters to read, moved past the word
+ * @param end one past the last character that may be read
+ * @return the length of the word, or EOF if there are no words left
+ */
+
+int getword_buf(char *s, int limit, char **pos, char *end) {
+    int c;
+    char *w = s;
+    assert(limit > 0 && s != NULL && pos != NULL && end != NULL);
+
+    do {
+        if (*pos == end) {
+            return EOF;
+        }
+        c = (unsigned char) *(*pos)++;
+    } while (!isalnum(c));
+
+    if (--limit > 0) {
+        *w++ = tolower(c);
+    }
+    while (--limit > 0 && *pos != end) {
+        if (isalnum(c = (unsigned char) *(*pos)++)) {
+            *w++ = tolower(c);
+        } else if ('\'' == c) {
+            limit++;
+        } else {
+            break;
+        }
+    }
+    *w = '\0';
+    return w - s;
+}
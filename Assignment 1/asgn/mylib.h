@@ -6,5 +6,6 @@
 extern void *emalloc(size_t);
 extern void *erealloc(void *, size_t);
 extern int getword(char *s, int limit, FILE *stream);
+extern int getword_buf(char *s, int limit, char **pos, char *end);
 
 #endif
@@ -0,0 +1,383 @@
+/*
+ * Implementation of sketch.h
+ *
+ * Approximate word counting in a fixed amount of memory. A Count-Min
+ * sketch estimates the frequency of any word, never too low and, with
+ * probability 1 - delta, too high by at most epsilon times the number
+ * of words seen. Alongside it a Space-Saving table follows the 1 /
+ * epsilon words that look most frequent, which is enough to be sure
+ * of following every word seen more than epsilon times the number of
+ * words.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "sketch.h"
+#include "mylib.h"
+
+#define E 2.718281828459045
+
+/*
+ * A word followed by the Space-Saving table. count never falls below
+ * the true frequency of the word. pos is where it is in the heap.
+ */
+
+struct hitter {
+    char *word;
+    uint64_t hash;
+    int count;
+    int pos;
+};
+
+/*
+ * The Count-Min sketch is depth rows of width counters. The hitters
+ * are kept in a min-heap on count, in heap, so the least frequent can
+ * be replaced in O(log k), and found by word through index, a linear
+ * probing table of hitter numbers with -1 for an empty slot.
+ */
+
+struct sketchrec {
+    unsigned int *counters;
+    int width;
+    int depth;
+    long total;
+    struct hitter *hitters;
+    int *heap;
+    int size;
+    int k;
+    int *index;
+    int index_size;
+};
+
+/*
+ * Creates an empty sketch.
+ * @param epsilon how far off an estimate may be, as a fraction of the
+ * number of words seen
+ * @param delta chance of an estimate being further off than that
+ * @return the empty sketch
+ */
+
+sketch sketch_new(double epsilon, double delta) {
+    sketch s = emalloc(sizeof *s);
+    double chance;
+    int i;
+
+    /* width of e / epsilon and depth of ln(1 / delta), rounded up */
+    s->width = (int) (E / epsilon) + 1;
+    for (s->depth = 1, chance = 1.0 / E; chance > delta; s->depth++) {
+        chance /= E;
+    }
+    s->counters = emalloc((size_t) s->width * s->depth * sizeof s->counters[0]);
+    memset(s->counters, 0, (size_t) s->width * s->depth * sizeof s->counters[0]);
+    s->total = 0;
+    s->k = (int) (1.0 / epsilon) + 1;
+    s->size = 0;
+    s->hitters = emalloc(s->k * sizeof s->hitters[0]);
+    s->heap = emalloc(s->k * sizeof s->heap[0]);
+    for (s->index_size = 2; s->index_size < 2 * s->k; s->index_size *= 2)
+        ;
+    s->index = emalloc(s->index_size * sizeof s->index[0]);
+    for (i = 0; i < s->index_size; i++) {
+        s->index[i] = -1;
+    }
+    return s;
+}
+
+/*
+ * 64-bit FNV-1a hash of a word, with a final mix so both halves can
+ * be used as separate hashes.
+ * @param word word to hash
+ * @return the hash
+ */
+
+static uint64_t sketch_hash(char *word) {
+    uint64_t result = UINT64_C(14695981039346656037);
+    while (*word != '\0') {
+        result ^= (unsigned char) *word++;
+        result *= UINT64_C(1099511628211);
+    }
+    result ^= result >> 33;
+    result *= UINT64_C(0xff51afd7ed558ccd);
+    result ^= result >> 33;
+    return result;
+}
+
+/*
+ * Counter of a word in one row of the sketch. The rows use the hashes
+ * low + row * high, which are as good as independent ones here.
+ * @param s the sketch
+ * @param hash hash of the word from sketch_hash
+ * @param row the row
+ * @return the counter
+ */
+
+static unsigned int *sketch_counter(sketch s, uint64_t hash, int row) {
+    uint32_t low = (uint32_t) hash, high = (uint32_t) (hash >> 32);
+    return &s->counters[(size_t) row * s->width + (low + (uint32_t) row * high) % s->width];
+}
+
+/*
+ * Finds the slot of index that holds a hitter, or the empty slot
+ * where it would go.
+ * @param s the sketch
+ * @param word the word of the hitter
+ * @param hash hash of the word from sketch_hash
+ * @return the slot
+ */
+
+static int sketch_find(sketch s, char *word, uint64_t hash) {
+    int slot = (int) (hash >> 32) & (s->index_size - 1);
+
+    while (s->index[slot] != -1 && (s->hitters[s->index[slot]].hash != hash
+                                    || strcmp(s->hitters[s->index[slot]].word, word) != 0)) {
+        slot = (slot + 1) & (s->index_size - 1);
+    }
+    return slot;
+}
+
+/*
+ * Empties a slot of index, moving back the hitters after it that
+ * could no longer be found.
+ * @param s the sketch
+ * @param slot the slot to empty
+ */
+
+static void sketch_unindex(sketch s, int slot) {
+    int next = (slot + 1) & (s->index_size - 1);
+    int home;
+
+    s->index[slot] = -1;
+    while (s->index[next] != -1) {
+        home = (int) (s->hitters[s->index[next]].hash >> 32) & (s->index_size - 1);
+        /* move it back if it could not be found past the empty slot */
+        if (slot <= next ? home <= slot || home > next : home <= slot && home > next) {
+            s->index[slot] = s->index[next];
+            s->index[next] = -1;
+            slot = next;
+        }
+        next = (next + 1) & (s->index_size - 1);
+    }
+}
+
+/*
+ * Swaps two entries of the heap.
+ */
+
+static void sketch_swap(sketch s, int i, int j) {
+    int tmp = s->heap[i];
+    s->heap[i] = s->heap[j];
+    s->heap[j] = tmp;
+    s->hitters[s->heap[i]].pos = i;
+    s->hitters[s->heap[j]].pos = j;
+}
+
+/*
+ * Moves a heap entry whose count has gone up down to where it belongs.
+ * @param s the sketch
+ * @param i position of the entry in the heap
+ */
+
+static void sketch_sift_down(sketch s, int i) {
+    int child;
+
+    while ((child = 2 * i + 1) < s->size) {
+        if (child + 1 < s->size
+            && s->hitters[s->heap[child + 1]].count < s->hitters[s->heap[child]].count) {
+            child++;
+        }
+        if (s->hitters[s->heap[child]].count >= s->hitters[s->heap[i]].count) {
+            return;
+        }
+        sketch_swap(s, i, child);
+        i = child;
+    }
+}
+
+/*
+ * Moves a heap entry whose count is lower than its parent's up to
+ * where it belongs.
+ * @param s the sketch
+ * @param i position of the entry in the heap
+ */
+
+static void sketch_sift_up(sketch s, int i) {
+    int parent;
+
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (s->hitters[s->heap[parent]].count <= s->hitters[s->heap[i]].count) {
+            return;
+        }
+        sketch_swap(s, i, parent);
+        i = parent;
+    }
+}
+
+/*
+ * Counts one occurrence of a word. Every row of the sketch is updated,
+ * and then the word is counted in the Space-Saving table. A word that
+ * is not being followed takes the place of the least frequent one,
+ * with a count of one more than that word's. The sketch estimate is
+ * not used for that count even when it is lower: the least count in
+ * the table would then go down, and a word replaced earlier on at a
+ * higher count would come back too low.
+ * @param s the sketch
+ * @param word the word to count
+ */
+
+void sketch_insert(sketch s, char *word) {
+    uint64_t hash = sketch_hash(word);
+    struct hitter *hit;
+    int row, slot, i, least;
+
+    for (row = 0; row < s->depth; row++) {
+        ++*sketch_counter(s, hash, row);
+    }
+    s->total++;
+
+    slot = sketch_find(s, word, hash);
+    if (s->index[slot] != -1) {
+        hit = &s->hitters[s->index[slot]];
+        hit->count++;
+        sketch_sift_down(s, hit->pos);
+        return;
+    }
+    if (s->size < s->k) {
+        i = s->size;
+        s->heap[i] = i;
+        s->hitters[i].pos = i;
+        s->size++;
+        least = 0;
+    } else {
+        /* replace the least frequent word, at the top of the heap */
+        i = s->heap[0];
+        least = s->hitters[i].count;
+        sketch_unindex(s, sketch_find(s, s->hitters[i].word, s->hitters[i].hash));
+        free(s->hitters[i].word);
+        slot = sketch_find(s, word, hash);
+    }
+    hit = &s->hitters[i];
+    hit->word = emalloc(strlen(word) + 1);
+    strcpy(hit->word, word);
+    hit->hash = hash;
+    hit->count = least + 1;
+    s->index[slot] = i;
+    /* a new word at the bottom of the heap has the lowest count there
+       is, while one at the top may count more than its children */
+    sketch_sift_up(s, hit->pos);
+    sketch_sift_down(s, hit->pos);
+}
+
+/*
+ * Estimates how often a word has been seen. The estimate is never too
+ * low.
+ * @param s the sketch
+ * @param word the word
+ * @return the estimated frequency
+ */
+
+int sketch_estimate(sketch s, char *word) {
+    uint64_t hash = sketch_hash(word);
+    unsigned int estimate = UINT32_MAX, *counter;
+    int row, slot;
+
+    for (row = 0; row < s->depth; row++) {
+        counter = sketch_counter(s, hash, row);
+        if (*counter < estimate) {
+            estimate = *counter;
+        }
+    }
+    slot = sketch_find(s, word, hash);
+    if (s->index[slot] != -1 && (unsigned int) s->hitters[s->index[slot]].count < estimate) {
+        return s->hitters[s->index[slot]].count;
+    }
+    return (int) estimate;
+}
+
+/*
+ * A word followed by the Space-Saving table with its estimated
+ * frequency, for sketch_top to sort.
+ */
+
+struct ranked {
+    int freq;
+    char *word;
+};
+
+/*
+ * Orders ranked words by frequency, with ties going to the word that
+ * comes first alphabetically.
+ */
+
+static int sketch_compare(const void *a, const void *b) {
+    const struct ranked *x = a;
+    const struct ranked *y = b;
+
+    if (x->freq != y->freq) {
+        return x->freq < y->freq ? 1 : -1;
+    }
+    return strcmp(x->word, y->word);
+}
+
+/*
+ * Passes the k most frequent words followed by the Space-Saving table,
+ * with their estimated frequencies, to p, most frequent first.
+ * @param s the sketch
+ * @param k how many words to pass
+ * @param p function to call for each word
+ */
+
+void sketch_top(sketch s, int k, void p(int freq, char *word)) {
+    struct ranked *sorted = emalloc((s->size > 0 ? s->size : 1) * sizeof sorted[0]);
+    int i;
+
+    for (i = 0; i < s->size; i++) {
+        sorted[i].word = s->hitters[i].word;
+        sorted[i].freq = sketch_estimate(s, sorted[i].word);
+    }
+    qsort(sorted, s->size, sizeof sorted[0], sketch_compare);
+    for (i = 0; i < s->size && i < k; i++) {
+        p(sorted[i].freq, sorted[i].word);
+    }
+    free(sorted);
+}
+
+/*
+ * Prints the size of the sketch and the bounds on its estimates.
+ * @param s the sketch
+ * @param stream the stream to send output to
+ */
+
+void sketch_print_stats(sketch s, FILE *stream) {
+    double chance = 1.0;
+    int row;
+
+    for (row = 0; row < s->depth; row++) {
+        chance /= E;
+    }
+    fprintf(stream, "Count-Min sketch: %d x %d counters, %lu bytes\n", s->depth,
+            s->width, (unsigned long) ((size_t) s->width * s->depth * sizeof s->counters[0]));
+    fprintf(stream, "Words seen: %ld, estimates at most %.0f too high with "
+            "probability %.4f\n", s->total, E / s->width * s->total, 1.0 - chance);
+    fprintf(stream, "Space-Saving: following %d of at most %d words\n", s->size, s->k);
+}
+
+/*
+ * Frees the sketch.
+ * @param s the sketch to free
+ */
+
+void sketch_free(sketch s) {
+    int i;
+
+    for (i = 0; i < s->size; i++) {
+        free(s->hitters[i].word);
+    }
+    free(s->counters);
+    free(s->hitters);
+    free(s->heap);
+    free(s->index);
+    free(s);
+}
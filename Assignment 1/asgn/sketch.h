@@ -0,0 +1,13 @@
+#ifndef SKETCH_H_
+#define SKETCH_H_
+
+typedef struct sketchrec *sketch;
+
+extern sketch sketch_new(double epsilon, double delta);
+extern void   sketch_insert(sketch s, char *word);
+extern int    sketch_estimate(sketch s, char *word);
+extern void   sketch_top(sketch s, int k, void p(int freq, char *word));
+extern void   sketch_print_stats(sketch s, FILE *stream);
+extern void   sketch_free(sketch s);
+
+#endif
@@ -0,0 +1,175 @@
+/*
+ * Stress test for chtable.
+ *
+ * Reads words from stdin, then has several threads insert all of them
+ * into one chtable at the same time, each thread taking every n-th word
+ * so they fight over the same keys. After every insert a thread searches
+ * for the word again and checks the count is at least 1 and no more
+ * than the word's real frequency. Once the threads are done, every
+ * frequency is compared with an htable filled by htable_insert on one
+ * thread. This is repeated for several rounds.
+ *
+ * Build from the asgn directory with
+ *
+ *    gcc -O2 -W -Wall -std=c99 -pedantic -pthread stress/chtable_stress.c \
+ *        chtable.c htable.c bloom.c arena.c mylib.c -o chtable_stress
+ *
+ * and run with e.g. ./chtable_stress 8 < corpus.txt
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "../chtable.h"
+#include "../htable.h"
+#include "../mylib.h"
+
+#define THREADS 4
+#define ROUNDS 5
+#define MAX_LOAD 0.7
+
+/*
+ * The work given to one thread.
+ */
+
+struct worker {
+    pthread_t thread;
+    int first;
+};
+
+static chtable shared;
+static htable expected;
+static char **words;
+static int *freqs;
+static int num_words;
+static int num_threads;
+static int num_distinct;
+static int errors;
+
+/*
+ * Inserts every num_threads-th word into the shared table, starting at
+ * the worker's first word, checking each count as it goes.
+ * @param arg the worker
+ * @return NULL
+ */
+
+static void *insert_words(void *arg) {
+    struct worker *w = arg;
+    int i, freq;
+
+    for (i = w->first; i < num_words; i += num_threads) {
+        freq = chtable_insert(shared, words[i]);
+        if (freq < 1 || freq > freqs[i]) {
+            fprintf(stderr, "insert '%s' gave %d, expected 1 to %d\n",
+                    words[i], freq, freqs[i]);
+            __atomic_add_fetch(&errors, 1, __ATOMIC_RELAXED);
+        }
+        freq = chtable_search(shared, words[i]);
+        if (freq < 1 || freq > freqs[i]) {
+            fprintf(stderr, "search '%s' gave %d, expected 1 to %d\n",
+                    words[i], freq, freqs[i]);
+            __atomic_add_fetch(&errors, 1, __ATOMIC_RELAXED);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Checks a word counted on one thread against the shared table.
+ * @param freq frequency counted on one thread
+ * @param word the word
+ */
+
+static void check_expected(int freq, char *word) {
+    int found = chtable_search(shared, word);
+    num_distinct++;
+    if (found != freq) {
+        fprintf(stderr, "'%s' counted %d times, expected %d\n", word, found, freq);
+        errors++;
+    }
+}
+
+/*
+ * Checks a word in the shared table against the one counted on one
+ * thread, which catches a word being given two slots.
+ * @param freq frequency in the shared table
+ * @param word the word
+ */
+
+static void check_shared(int freq, char *word) {
+    int found = htable_search(expected, word);
+    if (found != freq) {
+        fprintf(stderr, "'%s' is in the shared table %d times, expected %d\n",
+                word, freq, found);
+        errors++;
+    }
+}
+
+int main(int argc, char **argv) {
+    struct worker *workers;
+    char word[256];
+    int capacity = 1024, round, i;
+
+    num_threads = argc > 1 ? atoi(argv[1]) : THREADS;
+    if (num_threads < 1) {
+        fprintf(stderr, "usage: %s [THREADS] < words\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    words = emalloc(capacity * sizeof words[0]);
+    while (getword(word, sizeof word, stdin) != EOF) {
+        if (num_words == capacity) {
+            capacity *= 2;
+            words = erealloc(words, capacity * sizeof words[0]);
+        }
+        words[num_words++] = strcpy(emalloc(strlen(word) + 1), word);
+    }
+
+    expected = htable_new(113, LINEAR_P);
+    htable_set_max_load(expected, MAX_LOAD);
+    for (i = 0; i < num_words; i++) {
+        htable_insert(expected, words[i]);
+    }
+    freqs = emalloc((num_words + 1) * sizeof freqs[0]);
+    for (i = 0; i < num_words; i++) {
+        freqs[i] = htable_search(expected, words[i]);
+    }
+
+    workers = emalloc(num_threads * sizeof workers[0]);
+    for (round = 0; round < ROUNDS; round++) {
+        shared = chtable_new(2 * num_words + 1);
+        for (i = 0; i < num_threads; i++) {
+            workers[i].first = i;
+            if (pthread_create(&workers[i].thread, NULL, insert_words, &workers[i]) != 0) {
+                fprintf(stderr, "Could not create thread %d\n", i);
+                return EXIT_FAILURE;
+            }
+        }
+        for (i = 0; i < num_threads; i++) {
+            pthread_join(workers[i].thread, NULL);
+        }
+
+        num_distinct = 0;
+        htable_print(expected, check_expected);
+        chtable_print(shared, check_shared);
+        if (chtable_num_keys(shared) != num_distinct) {
+            fprintf(stderr, "shared table has %d words, expected %d\n",
+                    chtable_num_keys(shared), num_distinct);
+            errors++;
+        }
+        chtable_free(shared);
+    }
+
+    printf("%d words, %d different, %d threads, %d rounds: %d errors\n",
+           num_words, num_distinct, num_threads, ROUNDS, errors);
+
+    for (i = 0; i < num_words; i++) {
+        free(words[i]);
+    }
+    free(words);
+    free(freqs);
+    free(workers);
+    htable_free(expected);
+    return errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,135 @@
+/*
+ * Stress test for sketch.
+ *
+ * Counts a skewed stream of words both with a sketch and exactly with
+ * an htable, then checks that no estimate is lower than the real
+ * frequency, neither from sketch_estimate nor from sketch_top, and
+ * that every word seen more than epsilon times the number of words is
+ * among the ones sketch_top passes on. Word i of the stream's
+ * vocabulary turns up about 1 / i as often as word 1, in an order
+ * mixed up by a fixed generator, so every run sees the same stream.
+ *
+ * Build from the asgn directory with
+ *
+ *    gcc -O2 -W -Wall -std=c99 -pedantic stress/sketch_stress.c \
+ *        sketch.c htable.c bloom.c arena.c mylib.c -o sketch_stress
+ *
+ * and run with e.g. ./sketch_stress 0.001
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../htable.h"
+#include "../mylib.h"
+#include "../sketch.h"
+
+#define EPSILON 0.01
+#define DELTA 0.01
+#define VOCABULARY 20000
+#define STREAM 1000000
+#define MAX_LOAD 0.7
+
+static sketch approx;
+static htable exact;
+static htable reported;
+static long threshold;
+static int errors;
+
+/*
+ * Returns the next number from a fixed linear congruential generator.
+ * @param state the generator's state
+ * @return a number from 0 to 2^31 - 1
+ */
+
+static unsigned long next_random(unsigned long *state) {
+    *state = (*state * 1103515245UL + 12345UL) & 0x7fffffffUL;
+    return *state;
+}
+
+/*
+ * Checks the estimate of a word counted exactly.
+ * @param freq the real frequency of the word
+ * @param word the word
+ */
+
+static void check_estimate(int freq, char *word) {
+    int estimate = sketch_estimate(approx, word);
+
+    if (estimate < freq) {
+        fprintf(stderr, "'%s' estimated %d times, seen %d\n", word, estimate, freq);
+        errors++;
+    }
+    if (freq > threshold && htable_search(reported, word) == 0) {
+        fprintf(stderr, "'%s' seen %d times but not among the top words\n", word, freq);
+        errors++;
+    }
+}
+
+/*
+ * Checks a word passed on by sketch_top.
+ * @param freq the frequency the sketch gives
+ * @param word the word
+ */
+
+static void check_top(int freq, char *word) {
+    int real = htable_search(exact, word);
+
+    htable_insert(reported, word);
+    if (freq < real) {
+        fprintf(stderr, "'%s' is a top word %d times, seen %d\n", word, freq, real);
+        errors++;
+    }
+}
+
+int main(int argc, char **argv) {
+    double epsilon = argc > 1 ? atof(argv[1]) : EPSILON;
+    unsigned long state = 1;
+    double *weights = emalloc(VOCABULARY * sizeof weights[0]);
+    double sum = 0.0, pick;
+    char word[32];
+    int i, j, low, high;
+
+    if (epsilon <= 0.0 || epsilon >= 1.0) {
+        fprintf(stderr, "usage: %s [EPSILON]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < VOCABULARY; i++) {
+        sum += 1.0 / (i + 1);
+        weights[i] = sum;
+    }
+
+    approx = sketch_new(epsilon, DELTA);
+    exact = htable_new(113, LINEAR_P);
+    reported = htable_new(113, LINEAR_P);
+    htable_set_max_load(exact, MAX_LOAD);
+    htable_set_max_load(reported, MAX_LOAD);
+    for (i = 0; i < STREAM; i++) {
+        pick = sum * next_random(&state) / 0x80000000UL;
+        /* binary search for the first word whose running weight is past pick */
+        for (low = 0, high = VOCABULARY - 1; low < high; ) {
+            j = (low + high) / 2;
+            if (weights[j] <= pick) {
+                low = j + 1;
+            } else {
+                high = j;
+            }
+        }
+        j = low;
+        sprintf(word, "w%d", j);
+        sketch_insert(approx, word);
+        htable_insert(exact, word);
+    }
+
+    threshold = (long) (epsilon * STREAM);
+    sketch_top(approx, VOCABULARY, check_top);
+    htable_print(exact, check_estimate);
+
+    printf("%d words, epsilon %g: %d errors\n", STREAM, epsilon, errors);
+
+    free(weights);
+    sketch_free(approx);
+    htable_free(exact);
+    htable_free(reported);
+    return errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,13 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stddef.h>
+
+typedef struct arenarec *arena;
+
+extern arena  arena_new(void);
+extern void  *arena_alloc(arena a, size_t size);
+extern char  *arena_strdup(arena a, char *str);
+extern void   arena_free(arena a);
+
+#endif
@@ -1,6 +1,6 @@
 /**
  *MAIN TEST FILE
- *Program to implement tree ADT - either BST or RBT as determined by user
+ *Program to implement tree ADT - either BST, RBT, B-tree or ART as determined by user
  *Program will print information about the tree based on command line prompts from user
  *@AUTHOR Yashna Shetty, Haani Sommerville
  */
@@ -33,6 +33,8 @@ static void print_help(){
 Perform various operations using a binary tree.  By default, words\n\
 are read from stdin and added to the tree, before being printed out\n\
 alongside their frequencies to stdout.\n\n");
+    printf(" -a           Make the tree an adaptive radix tree (the default is a BST)\n");
+    printf(" -b           Make the tree a B-tree (the default is a BST)\n");
     printf(" -c FILENAME  Check spelling of words in FILENAME using words\n\
               read from stdin as the dictionary. Print timing \n\
               info & unknown words to stderr (ignore -d & -o \n");
@@ -46,7 +48,8 @@ alongside their frequencies to stdout.\n\n");
 /**
  * Main function gets the command line input from user to execute
  * various implementations of tree ADT. By default, creates a BST tree
- * and prints via preorder.
+ * and prints via preorder. If -r, -b or -a is given, creates an RBT, a
+ * B-tree or an adaptive radix tree instead.
  * Assumes cases are false. Sets to true when user inputs to command line.
  * If -c is given, program takes file from stdin as dictionary and user-
  * specified file as the file of word to check the spelling of. Prints all
@@ -63,17 +66,24 @@ int main(int argc, char *argv[]) {
     tree t;
     FILE *spellfile = NULL, *dotfile = NULL;
     char word[256], *file_name = NULL;
-    int case_f = 0, case_o = 0, case_c =0, case_d =0, case_r =0;
+    int case_f = 0, case_o = 0, case_c =0, case_d =0;
+    tree_t type = BST;
     clock_t start, end;
     double search_time = 0.0, fill_time = 0.0;
     int unknown = 0;
 
 
-    const char *optstring = "c:df:orh";
+    const char *optstring = "abc:df:orh";
     char option;
 
     while ((option = getopt(argc, argv, optstring)) != EOF) {
         switch(option) {
+            case 'a':
+                type = ART;
+                break;
+            case 'b':
+                type = BTREE;
+                break;
             case 'c':
                 spellfile = fopen(optarg, "r");
                 case_c = 1;
@@ -90,7 +100,7 @@ int main(int argc, char *argv[]) {
                 case_o = 1;
                 break;
             case 'r':
-                case_r = 1;
+                type = RBT;
                 break;
             case 'h':
                 print_help();
@@ -105,26 +115,27 @@ int main(int argc, char *argv[]) {
 
     /**
      * Build the tree from the file specified from stdin.
-     * If -r is given, the tree should be built as an RBT
-     * otherwise build as the default BST.
+     * If -r is given, the tree should be built as an RBT,
+     * if -b is given as a B-tree, if -a is given as an
+     * adaptive radix tree, otherwise build as the default BST.
      */
     
-    if(case_r == 1){
-        t = tree_new(RBT);
-    } else {
-        t = tree_new(BST);
-    }
+    t = tree_new(type);
     
     start = clock();
     while (getword(word, sizeof word, stdin) != EOF){
         t = tree_insert(t, word);
     }
+    if (case_c == 1) {
+        tree_freeze(t);
+    }
     end = clock();
     fill_time =((end - start)) / (double)CLOCKS_PER_SEC;
 
     /**
-     * If -c is given, search the tree for each word through
-     * tree_search function. Print any unknown words to stdout
+     * If -c is given, the tree is frozen once the dictionary is
+     * read, which is counted in the fill time, and is then searched
+     * for each word through tree_search function. Print any unknown words to stdout
      * and the information about fill and search time and
      * unknown word count to stderr.
      */
@@ -9,6 +9,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include "arena.h"
 #include "mylib.h"
 #include "tree.h"
 
@@ -20,50 +23,1253 @@
 #define IS_RED(x) ((NULL != (x)) && (RED == (x)->colour))
 
 /**
- * Initialise tree type variable.
+ * The deepest an RBT can get. Red-black trees are at most about twice
+ * as deep as a perfectly balanced tree, so this is plenty for any
+ * number of nodes an int can count.
  */
 
-static tree_t tree_type;
+#define RBT_MAX_DEPTH 128
 
 /**
- * Declare the struct for the tree.
- * Initialise the fields to build our tree.
+ * A B-tree node holds up to BTREE_MAX_KEYS keys, which with their
+ * prefixes, counts and child pointers comes to seven cache lines. A node that
+ * fills up is split in two around its middle key.
  */
 
+#define BTREE_MAX_KEYS 15
+#define BTREE_MIDDLE (BTREE_MAX_KEYS / 2)
+
+/**
+ * How many bytes of a compressed path an ART node keeps. Longer paths
+ * are checked against a key below the node.
+ */
+
+#define ART_MAX_PREFIX 8
+
+/**
+ * How many levels ahead a frozen search prefetches the key prefixes.
+ * 8 prefixes fill a cache line, and the descendants of a slot three
+ * levels down are 8 slots next to each other.
+ */
+
+#define FROZEN_PREFETCH 8
+
+#ifdef __GNUC__
+#define PREFETCH(p) __builtin_prefetch(p)
+#else
+#define PREFETCH(p) ((void) (p))
+#endif
+
+/**
+ * Declare the struct for the nodes of the tree.
+ * Initialise the fields to build our tree. The first 8 bytes
+ * of the key are kept in the node too (see tree_key_prefix),
+ * so most comparisons never read the key itself.
+ */
+
+typedef struct tree_node *node;
+
 struct tree_node { 
+    uint64_t prefix;
     char *key;
+    node left;
+    node right;
     tree_colour colour;
-    tree left;
-    tree right;
     int freq;
 };
 
+/**
+ * Declare the struct for the nodes of a B-tree. The keys are kept in
+ * sorted order, and children[i] holds the keys that sort between
+ * keys[i - 1] and keys[i]. Leaves have no children, which is marked
+ * by children[0] being NULL. The prefixes of the keys are kept
+ * next to them, so a binary search mostly stays in the node.
+ */
+
+typedef struct btree_node *bnode;
+
+struct btree_node {
+    int num_keys;
+    int freq[BTREE_MAX_KEYS];
+    uint64_t prefixes[BTREE_MAX_KEYS];
+    char *keys[BTREE_MAX_KEYS];
+    bnode children[BTREE_MAX_KEYS + 1];
+};
+
+/**
+ * Declare the structs for the nodes of an adaptive radix tree (ART).
+ * Each key, with its terminating '\0' so no key is a prefix of another,
+ * is spelt out one byte per level. Inner nodes come in four sizes and
+ * grow into the next size when full: node4 and node16 keep sorted byte
+ * and child arrays, node48 maps each byte to one of 48 children, and
+ * node256 has a child for every byte. Bytes that every key below a node
+ * shares are kept in the node rather than as a chain of one-child
+ * nodes, and a key whose path is unique is kept in a leaf as soon as
+ * it branches off. Every kind of node starts with its type, so any of
+ * them can be pointed to by an anode.
+ */
+
+typedef enum art_e {
+    ART_LEAF, ART_NODE4, ART_NODE16, ART_NODE48, ART_NODE256
+} art_t;
+
+typedef struct art_node *anode;
+
+struct art_node {
+    unsigned char type;
+    unsigned short num_children;
+    unsigned int prefix_len;
+    unsigned char prefix[ART_MAX_PREFIX];
+};
+
+struct art_leaf {
+    unsigned char type;
+    int freq;
+    char *key;
+};
+
+struct art_node4 {
+    struct art_node n;
+    unsigned char keys[4];
+    anode children[4];
+};
+
+struct art_node16 {
+    struct art_node n;
+    unsigned char keys[16];
+    anode children[16];
+};
+
+struct art_node48 {
+    struct art_node n;
+    unsigned char index[256];
+    anode children[48];
+};
+
+struct art_node256 {
+    struct art_node n;
+    anode children[256];
+};
+
+/**
+ * The tree handle. Everything a tree needs is kept here rather than
+ * in globals, so any number of trees, of either type, can be used at
+ * once, each by its own thread if need be.
+ * Trees from tree_new take their nodes and keys from two slabs, so
+ * nodes made one after another sit together and freeing the tree is
+ * only a few block frees. Trees from tree_new_alloc have no slabs and
+ * call their allocator once per node and once per key.
+ */
+
+struct treerec {
+    node root;
+    bnode broot;
+    anode aroot;
+    tree_t type;
+    int num_nodes;
+    uint64_t *prefixes;
+    unsigned int *frozen;
+    char *pool;
+    arena nodes;
+    arena keys;
+    void *(*alloc)(size_t);
+    void (*dealloc)(void *);
+};
+
 /**
  * Initialise our tree, which is currently empty.
- * @param type BST or RBT tree
- * @return NULL empty tree
+ * @param type BST, RBT, BTREE or ART tree
+ * @return the empty tree
  */
 
 tree tree_new(tree_t type) {
-    tree_type = type;
-    return NULL;
+    tree t = tree_new_alloc(type, emalloc, free);
+    t->nodes = arena_new();
+    t->keys = arena_new();
+    return t;
+}
+
+/**
+ * Initialise an empty tree that gets the memory for its nodes and
+ * keys from the given allocator.
+ * @param type BST, RBT, BTREE or ART tree
+ * @param alloc allocates memory, never returning NULL
+ * @param dealloc frees memory from alloc
+ * @return the empty tree
+ */
+
+tree tree_new_alloc(tree_t type, void *alloc(size_t), void dealloc(void *)) {
+    tree t = emalloc(sizeof *t);
+    t->root = NULL;
+    t->broot = NULL;
+    t->aroot = NULL;
+    t->type = type;
+    t->num_nodes = 0;
+    t->prefixes = NULL;
+    t->frozen = NULL;
+    t->pool = NULL;
+    t->nodes = NULL;
+    t->keys = NULL;
+    t->alloc = alloc;
+    t->dealloc = dealloc;
+    return t;
+}
+
+/**
+ * Returns the number of different words in the tree.
+ * @param t the tree
+ * @return the number of nodes
+ */
+
+int tree_size(tree t) {
+    return t->num_nodes;
+}
+
+/**
+ * Allocates memory for a node of the tree, from the node slab if it
+ * has one.
+ * @param t the tree the node is for
+ * @param size the size of the node
+ * @return the memory
+ */
+
+static void *tree_alloc(tree t, size_t size) {
+    if (t->nodes != NULL) {
+        return arena_alloc(t->nodes, size);
+    }
+    return t->alloc(size);
+}
+
+/**
+ * Makes the tree's own copy of a key, in the key slab if it has one.
+ * @param t the tree the key is for
+ * @param str the key to copy
+ * @return the copy
+ */
+
+static char *tree_copy_key(tree t, char *str) {
+    char *copy;
+    if (t->keys != NULL) {
+        return arena_strdup(t->keys, str);
+    }
+    copy = t->alloc(strlen(str)+1 *sizeof *str);
+    strcpy(copy, str);
+    return copy;
+}
+
+/**
+ * Packs the first 8 bytes of a key into an integer, first byte
+ * highest and padded with zeros, so comparing two prefixes as
+ * integers orders them the same way strcmp orders the keys. Keys
+ * with different prefixes need no strcmp, and keys shorter than 8
+ * bytes are equal exactly when their prefixes are.
+ * @param str the key
+ * @return the prefix of the key
+ */
+
+static uint64_t tree_key_prefix(const char *str) {
+    uint64_t prefix = 0;
+    int i;
+
+    for (i = 0; i < 8 && str[i] != '\0'; i++) {
+        prefix |= (uint64_t)(unsigned char)str[i] << (56 - 8 * i);
+    }
+    return prefix;
+}
+
+/**
+ * Compares str with a key, using their prefixes first. Only keys
+ * whose first 8 bytes match need strcmp, and only on the rest of
+ * them; if the prefixes match and end in a '\0' the keys are equal.
+ * @param prefix the prefix of str
+ * @param str the string being looked for
+ * @param key_prefix the prefix of key
+ * @param key the key to compare with
+ * @return less than, equal to or greater than 0 as str sorts before,
+ * the same as or after key
+ */
+
+static int tree_key_compare(uint64_t prefix, const char *str,
+                            uint64_t key_prefix, const char *key) {
+    if (prefix != key_prefix) {
+        return prefix < key_prefix ? -1 : 1;
+    }
+    if ((prefix & 0xff) == 0) {
+        return 0;
+    }
+    return strcmp(str + 8, key + 8);
+}
+
+/**
+ * Allocates an empty B-tree leaf.
+ * @param t the tree the node is for
+ * @return the new node
+ */
+
+static bnode btree_new_node(tree t) {
+    bnode b = tree_alloc(t, sizeof *b);
+    b->num_keys = 0;
+    b->children[0] = NULL;
+    return b;
+}
+
+/**
+ * Binary searches the keys of a B-tree node.
+ * @param b the node to search
+ * @param prefix the prefix of str
+ * @param str the word we're searching for
+ * @param found set to 1 if str is one of the keys, otherwise 0
+ * @return the index of str if found, otherwise the index of the
+ * child that str would be under
+ */
+
+static int btree_find(bnode b, uint64_t prefix, char *str, int *found) {
+    int low = 0, high = b->num_keys, mid, cmp;
+
+    while (low < high) {
+        mid = (low + high) / 2;
+        cmp = tree_key_compare(prefix, str, b->prefixes[mid], b->keys[mid]);
+        if (cmp < 0) {
+            high = mid;
+        } else if (cmp > 0) {
+            low = mid + 1;
+        } else {
+            *found = 1;
+            return mid;
+        }
+    }
+    *found = 0;
+    return low;
+}
+
+/**
+ * Splits the full child i of a B-tree node in two, moving the
+ * child's middle key up into the node.
+ * @param t the tree being inserted into
+ * @param b the node whose child is full; it must not be full itself
+ * @param i the index of the full child
+ */
+
+static void btree_split(tree t, bnode b, int i) {
+    bnode full = b->children[i];
+    bnode right = btree_new_node(t);
+    int j;
+
+    right->num_keys = BTREE_MAX_KEYS - BTREE_MIDDLE - 1;
+    for (j = 0; j < right->num_keys; j++) {
+        right->keys[j] = full->keys[BTREE_MIDDLE + 1 + j];
+        right->prefixes[j] = full->prefixes[BTREE_MIDDLE + 1 + j];
+        right->freq[j] = full->freq[BTREE_MIDDLE + 1 + j];
+    }
+    if (full->children[0] != NULL) {
+        for (j = 0; j <= right->num_keys; j++) {
+            right->children[j] = full->children[BTREE_MIDDLE + 1 + j];
+        }
+    }
+    full->num_keys = BTREE_MIDDLE;
+
+    for (j = b->num_keys; j > i; j--) {
+        b->keys[j] = b->keys[j - 1];
+        b->prefixes[j] = b->prefixes[j - 1];
+        b->freq[j] = b->freq[j - 1];
+        b->children[j + 1] = b->children[j];
+    }
+    b->keys[i] = full->keys[BTREE_MIDDLE];
+    b->prefixes[i] = full->prefixes[BTREE_MIDDLE];
+    b->freq[i] = full->freq[BTREE_MIDDLE];
+    b->children[i + 1] = right;
+    b->num_keys++;
+}
+
+/**
+ * Inserts str into a B-tree, or counts it again if it is there
+ * already. Full nodes are split on the way down, so there is always
+ * room in the leaf the walk ends at.
+ * @param t the tree to be inserted into
+ * @param str the string we want to insert into the tree
+ */
+
+static void btree_insert(tree t, char *str) {
+    uint64_t prefix = tree_key_prefix(str);
+    bnode b, root;
+    int i, j, found, cmp;
+
+    if (t->broot == NULL) {
+        t->broot = btree_new_node(t);
+    } else if (t->broot->num_keys == BTREE_MAX_KEYS) {
+        root = btree_new_node(t);
+        root->children[0] = t->broot;
+        btree_split(t, root, 0);
+        t->broot = root;
+    }
+
+    b = t->broot;
+    for (;;) {
+        i = btree_find(b, prefix, str, &found);
+        if (found) {
+            b->freq[i]++;
+            return;
+        }
+        if (b->children[0] == NULL) {
+            break;
+        }
+        if (b->children[i]->num_keys == BTREE_MAX_KEYS) {
+            btree_split(t, b, i);
+            cmp = tree_key_compare(prefix, str, b->prefixes[i], b->keys[i]);
+            if (cmp == 0) {
+                b->freq[i]++;
+                return;
+            }
+            if (cmp > 0) {
+                i++;
+            }
+        }
+        b = b->children[i];
+    }
+
+    for (j = b->num_keys; j > i; j--) {
+        b->keys[j] = b->keys[j - 1];
+        b->prefixes[j] = b->prefixes[j - 1];
+        b->freq[j] = b->freq[j - 1];
+    }
+    b->keys[i] = tree_copy_key(t, str);
+    b->prefixes[i] = prefix;
+    b->freq[i] = 1;
+    b->num_keys++;
+    t->num_nodes++;
+}
+
+/**
+ * Searches a B-tree for a word.
+ * @param b the root of the B-tree
+ * @param str the word/string we're searching for.
+ * @return 0 or 1, depending on whether the word is found
+ */
+
+static int btree_search(bnode b, char *str) {
+    uint64_t prefix = tree_key_prefix(str);
+    int i, found;
+
+    while (b != NULL) {
+        i = btree_find(b, prefix, str, &found);
+        if (found) {
+            return 1;
+        }
+        if (b->children[0] == NULL) {
+            return 0;
+        }
+        b = b->children[i];
+    }
+    return 0;
+}
+
+/**
+ * Returns the depth of a B-tree. Every leaf of a B-tree is at the
+ * same depth, so this only follows the leftmost path.
+ * @param b the root of the B-tree
+ * @return the number of edges from the root to a leaf, or -1 if
+ * the tree is empty
+ */
+
+static int btree_depth(bnode b) {
+    int depth = -1;
+
+    while (b != NULL) {
+        depth++;
+        b = b->children[0];
+    }
+    return depth;
+}
+
+/**
+ * Traverse a B-tree in order, applying f to every key in sorted
+ * order.
+ * @param b the subtree to traverse through
+ * @param void f() the function we want to use on the tree
+ */
+
+static void btree_inorder(bnode b, void f(int freq, char *s)) {
+    int i;
+
+    for (i = 0; i < b->num_keys; i++) {
+        if (b->children[0] != NULL) {
+            btree_inorder(b->children[i], f);
+        }
+        f(b->freq[i], b->keys[i]);
+    }
+    if (b->children[0] != NULL) {
+        btree_inorder(b->children[i], f);
+    }
+}
+
+/**
+ * Traverse a B-tree in preorder, applying f to all the keys in a
+ * node before going on to each of its children in turn.
+ * @param b the subtree to traverse through
+ * @param void f() the function we want to use on the tree
+ */
+
+static void btree_preorder(bnode b, void f(int freq, char *s)) {
+    int i;
+
+    for (i = 0; i < b->num_keys; i++) {
+        f(b->freq[i], b->keys[i]);
+    }
+    if (b->children[0] != NULL) {
+        for (i = 0; i <= b->num_keys; i++) {
+            btree_preorder(b->children[i], f);
+        }
+    }
+}
+
+/**
+ * Recursively free the memory allocated to a B-tree.
+ * @param t the tree the subtree belongs to
+ * @param b the subtree to free
+ */
+
+static void btree_free(tree t, bnode b) {
+    int i;
+
+    if (b->children[0] != NULL) {
+        for (i = 0; i <= b->num_keys; i++) {
+            btree_free(t, b->children[i]);
+        }
+    }
+    for (i = 0; i < b->num_keys; i++) {
+        t->dealloc(b->keys[i]);
+    }
+    t->dealloc(b);
+}
+
+/**
+ * Writes a DOT description of a B-tree. Each node is one record,
+ * named after its first key, with a port between each pair of keys
+ * for the child that sits there.
+ * @param b the subtree to output
+ * @param out the stream to write the DOT output to.
+ */
+
+static void btree_output_dot(bnode b, FILE *out) {
+    int i;
+
+    fprintf(out, "\"%s\"[label=\"<c0>", b->keys[0]);
+    for (i = 0; i < b->num_keys; i++) {
+        fprintf(out, "|%s:%d|<c%d>", b->keys[i], b->freq[i], i + 1);
+    }
+    fprintf(out, "\"color=black];\n");
+    if (b->children[0] != NULL) {
+        for (i = 0; i <= b->num_keys; i++) {
+            btree_output_dot(b->children[i], out);
+            fprintf(out, "\"%s\":c%d -> \"%s\";\n",
+                    b->keys[0], i, b->children[i]->keys[0]);
+        }
+    }
+}
+
+/**
+ * Allocates an empty ART inner node of the given kind.
+ * @param t the tree the node is for
+ * @param type the kind of node
+ * @return the new node
+ */
+
+static anode art_new_node(tree t, art_t type) {
+    size_t size;
+    anode n;
+
+    switch (type) {
+        case ART_NODE4:
+            size = sizeof(struct art_node4);
+            break;
+        case ART_NODE16:
+            size = sizeof(struct art_node16);
+            break;
+        case ART_NODE48:
+            size = sizeof(struct art_node48);
+            break;
+        default:
+            size = sizeof(struct art_node256);
+            break;
+    }
+    n = tree_alloc(t, size);
+    memset(n, 0, size);
+    n->type = type;
+    return n;
+}
+
+/**
+ * Allocates an ART leaf holding str.
+ * @param t the tree the leaf is for
+ * @param str the key to put in the leaf
+ * @return the new leaf
+ */
+
+static anode art_new_leaf(tree t, char *str) {
+    struct art_leaf *l = tree_alloc(t, sizeof *l);
+    l->type = ART_LEAF;
+    l->freq = 1;
+    l->key = tree_copy_key(t, str);
+    t->num_nodes++;
+    return (anode) l;
+}
+
+/**
+ * Finds the child of an ART inner node for a byte.
+ * @param n the node to look in
+ * @param c the byte of the key at this node's level
+ * @return the place the child is kept, or NULL if there is no child
+ */
+
+static anode *art_find_child(anode n, unsigned char c) {
+    struct art_node4 *n4;
+    struct art_node16 *n16;
+    struct art_node48 *n48;
+    struct art_node256 *n256;
+    int i;
+
+    switch (n->type) {
+        case ART_NODE4:
+            n4 = (struct art_node4 *) n;
+            for (i = 0; i < n->num_children; i++) {
+                if (n4->keys[i] == c) {
+                    return &n4->children[i];
+                }
+            }
+            return NULL;
+        case ART_NODE16:
+            n16 = (struct art_node16 *) n;
+            for (i = 0; i < n->num_children; i++) {
+                if (n16->keys[i] == c) {
+                    return &n16->children[i];
+                }
+            }
+            return NULL;
+        case ART_NODE48:
+            n48 = (struct art_node48 *) n;
+            return n48->index[c] ? &n48->children[n48->index[c] - 1] : NULL;
+        default:
+            n256 = (struct art_node256 *) n;
+            return n256->children[c] ? &n256->children[c] : NULL;
+    }
+}
+
+/**
+ * Steps through the children of an ART inner node in byte order.
+ * @param n the node whose children to step through
+ * @param pos where the last call left off, starting at 0
+ * @param c set to the byte the child is under
+ * @return the next child, or NULL when there are no more
+ */
+
+static anode art_next_child(anode n, int *pos, unsigned char *c) {
+    struct art_node4 *n4 = (struct art_node4 *) n;
+    struct art_node16 *n16 = (struct art_node16 *) n;
+    struct art_node48 *n48 = (struct art_node48 *) n;
+    struct art_node256 *n256 = (struct art_node256 *) n;
+
+    switch (n->type) {
+        case ART_NODE4:
+            if (*pos < n->num_children) {
+                *c = n4->keys[*pos];
+                return n4->children[(*pos)++];
+            }
+            return NULL;
+        case ART_NODE16:
+            if (*pos < n->num_children) {
+                *c = n16->keys[*pos];
+                return n16->children[(*pos)++];
+            }
+            return NULL;
+        case ART_NODE48:
+            for (; *pos < 256; (*pos)++) {
+                if (n48->index[*pos]) {
+                    *c = *pos;
+                    return n48->children[n48->index[(*pos)++] - 1];
+                }
+            }
+            return NULL;
+        default:
+            for (; *pos < 256; (*pos)++) {
+                if (n256->children[*pos]) {
+                    *c = *pos;
+                    return n256->children[(*pos)++];
+                }
+            }
+            return NULL;
+    }
+}
+
+/**
+ * Moves the children of a full ART node into a node of the next size
+ * up, which takes its place. The old node is freed unless it is in
+ * the node slab, where it stays until the tree is freed.
+ * @param t the tree the node is in
+ * @param ref where the node is kept
+ */
+
+static void art_grow(tree t, anode *ref) {
+    anode old = *ref, n;
+    unsigned char c;
+    int pos = 0, i = 0;
+    anode child;
+    struct art_node16 *n16;
+    struct art_node48 *n48;
+    struct art_node256 *n256;
+
+    n = art_new_node(t, old->type + 1);
+    n->num_children = old->num_children;
+    n->prefix_len = old->prefix_len;
+    memcpy(n->prefix, old->prefix, ART_MAX_PREFIX);
+    while ((child = art_next_child(old, &pos, &c)) != NULL) {
+        switch (n->type) {
+            case ART_NODE16:
+                n16 = (struct art_node16 *) n;
+                n16->keys[i] = c;
+                n16->children[i] = child;
+                break;
+            case ART_NODE48:
+                n48 = (struct art_node48 *) n;
+                n48->index[c] = i + 1;
+                n48->children[i] = child;
+                break;
+            default:
+                n256 = (struct art_node256 *) n;
+                n256->children[c] = child;
+                break;
+        }
+        i++;
+    }
+    if (t->nodes == NULL) {
+        t->dealloc(old);
+    }
+    *ref = n;
+}
+
+/**
+ * Adds a child to an ART inner node, growing the node if it is full.
+ * @param t the tree the node is in
+ * @param ref where the node is kept
+ * @param c the byte to add the child under
+ * @param child the child to add
+ */
+
+static void art_add_child(tree t, anode *ref, unsigned char c, anode child) {
+    anode n = *ref;
+    unsigned char *keys;
+    anode *children;
+    struct art_node48 *n48;
+    int i;
+
+    if ((n->type == ART_NODE4 && n->num_children == 4)
+        || (n->type == ART_NODE16 && n->num_children == 16)
+        || (n->type == ART_NODE48 && n->num_children == 48)) {
+        art_grow(t, ref);
+        n = *ref;
+    }
+    switch (n->type) {
+        case ART_NODE48:
+            n48 = (struct art_node48 *) n;
+            n48->index[c] = n->num_children + 1;
+            n48->children[n->num_children] = child;
+            break;
+        case ART_NODE256:
+            ((struct art_node256 *) n)->children[c] = child;
+            break;
+        default:
+            if (n->type == ART_NODE4) {
+                keys = ((struct art_node4 *) n)->keys;
+                children = ((struct art_node4 *) n)->children;
+            } else {
+                keys = ((struct art_node16 *) n)->keys;
+                children = ((struct art_node16 *) n)->children;
+            }
+            for (i = n->num_children; i > 0 && keys[i - 1] > c; i--) {
+                keys[i] = keys[i - 1];
+                children[i] = children[i - 1];
+            }
+            keys[i] = c;
+            children[i] = child;
+            break;
+    }
+    n->num_children++;
+}
+
+/**
+ * Finds the leaf with the smallest key below an ART node.
+ * @param n the node to start from
+ * @return the leftmost leaf
+ */
+
+static struct art_leaf *art_minimum(anode n) {
+    int pos;
+    unsigned char c;
+
+    while (n->type != ART_LEAF) {
+        pos = 0;
+        n = art_next_child(n, &pos, &c);
+    }
+    return (struct art_leaf *) n;
+}
+
+/**
+ * Compares the compressed path of an ART node with str. Bytes past
+ * the ones the node keeps are read from a key below it. The path never
+ * holds a '\0', so the comparison stops at the end of str.
+ * @param n the node whose path to compare
+ * @param str the key being looked for
+ * @param depth how many bytes of str are above the node
+ * @return how many bytes of the path match str
+ */
+
+static unsigned int art_prefix_mismatch(anode n, char *str, unsigned int depth) {
+    unsigned int i, max = n->prefix_len;
+    char *key;
+
+    if (max > ART_MAX_PREFIX) {
+        max = ART_MAX_PREFIX;
+    }
+    for (i = 0; i < max; i++) {
+        if (n->prefix[i] != (unsigned char) str[depth + i]) {
+            return i;
+        }
+    }
+    if (n->prefix_len > ART_MAX_PREFIX) {
+        key = art_minimum(n)->key;
+        for (; i < n->prefix_len; i++) {
+            if (key[depth + i] != str[depth + i]) {
+                return i;
+            }
+        }
+    }
+    return i;
+}
+
+/**
+ * Inserts str into an ART, or counts it again if it is there already.
+ * Where str leaves the tree it either becomes a new child, splits a
+ * leaf into a node4 over both keys, or splits a compressed path into
+ * a node4 over the part that matched.
+ * @param t the tree to be inserted into
+ * @param str the string we want to insert into the tree
+ */
+
+static void art_insert(tree t, char *str) {
+    anode *ref = &t->aroot, *child, n, split;
+    struct art_leaf *l;
+    unsigned int depth = 0, i, len;
+    char *key;
+
+    for (;;) {
+        n = *ref;
+        if (n == NULL) {
+            *ref = art_new_leaf(t, str);
+            return;
+        }
+        if (n->type == ART_LEAF) {
+            l = (struct art_leaf *) n;
+            if (strcmp(l->key, str) == 0) {
+                l->freq++;
+                return;
+            }
+            split = art_new_node(t, ART_NODE4);
+            i = 0;
+            while (l->key[depth + i] == str[depth + i]) {
+                i++;
+            }
+            split->prefix_len = i;
+            memcpy(split->prefix, str + depth, i < ART_MAX_PREFIX ? i : ART_MAX_PREFIX);
+            *ref = split;
+            art_add_child(t, ref, l->key[depth + i], n);
+            art_add_child(t, ref, str[depth + i], art_new_leaf(t, str));
+            return;
+        }
+        if (n->prefix_len > 0) {
+            i = art_prefix_mismatch(n, str, depth);
+            if (i < n->prefix_len) {
+                split = art_new_node(t, ART_NODE4);
+                split->prefix_len = i;
+                memcpy(split->prefix, n->prefix, i < ART_MAX_PREFIX ? i : ART_MAX_PREFIX);
+                len = n->prefix_len - i - 1;
+                if (n->prefix_len <= ART_MAX_PREFIX) {
+                    *ref = split;
+                    art_add_child(t, ref, n->prefix[i], n);
+                    memmove(n->prefix, n->prefix + i + 1, len);
+                } else {
+                    key = art_minimum(n)->key;
+                    *ref = split;
+                    art_add_child(t, ref, key[depth + i], n);
+                    memcpy(n->prefix, key + depth + i + 1,
+                           len < ART_MAX_PREFIX ? len : ART_MAX_PREFIX);
+                }
+                n->prefix_len = len;
+                art_add_child(t, ref, str[depth + i], art_new_leaf(t, str));
+                return;
+            }
+            depth += n->prefix_len;
+        }
+        child = art_find_child(n, str[depth]);
+        if (child == NULL) {
+            art_add_child(t, ref, str[depth], art_new_leaf(t, str));
+            return;
+        }
+        ref = child;
+        depth++;
+    }
+}
+
+/**
+ * Searches an ART for a word, one byte of the word per level. Only the
+ * bytes of a compressed path that the node keeps are compared, and the
+ * rest are skipped, as the leaf at the end is compared with the whole
+ * word anyway.
+ * @param n the root of the ART
+ * @param str the word/string we're searching for.
+ * @return 0 or 1, depending on whether the word is found
+ */
+
+static int art_search(anode n, char *str) {
+    unsigned int depth = 0, len = strlen(str), i, max;
+    anode *child;
+
+    while (n != NULL) {
+        if (n->type == ART_LEAF) {
+            return strcmp(((struct art_leaf *) n)->key, str) == 0;
+        }
+        if (n->prefix_len > 0) {
+            /* the path never holds a '\0', so this stops at the end of str */
+            max = n->prefix_len < ART_MAX_PREFIX ? n->prefix_len : ART_MAX_PREFIX;
+            for (i = 0; i < max; i++) {
+                if (n->prefix[i] != (unsigned char) str[depth + i]) {
+                    return 0;
+                }
+            }
+            depth += n->prefix_len;
+            if (depth > len) {
+                return 0;
+            }
+        }
+        child = art_find_child(n, str[depth]);
+        if (child == NULL) {
+            return 0;
+        }
+        n = *child;
+        depth++;
+    }
+    return 0;
+}
+
+/**
+ * Returns the length of the longest path between an ART node and the
+ * furthest leaf below it.
+ * @param n the subtree
+ * @return the longest path
+ */
+
+static int art_depth(anode n) {
+    int pos = 0, depth, deepest = 0;
+    unsigned char c;
+    anode child;
+
+    if (n->type == ART_LEAF) {
+        return 0;
+    }
+    while ((child = art_next_child(n, &pos, &c)) != NULL) {
+        depth = art_depth(child) + 1;
+        if (depth > deepest) {
+            deepest = depth;
+        }
+    }
+    return deepest;
+}
+
+/**
+ * Traverse an ART in order, applying f to every key. Children are
+ * visited in byte order, so keys come out in the order strcmp sorts
+ * them.
+ * @param n the subtree to traverse through
+ * @param void f() the function we want to use on the tree
+ */
+
+static void art_inorder(anode n, void f(int freq, char *s)) {
+    int pos = 0;
+    unsigned char c;
+    anode child;
+
+    if (n->type == ART_LEAF) {
+        f(((struct art_leaf *) n)->freq, ((struct art_leaf *) n)->key);
+        return;
+    }
+    while ((child = art_next_child(n, &pos, &c)) != NULL) {
+        art_inorder(child, f);
+    }
+}
+
+/**
+ * Recursively free the memory allocated to an ART.
+ * @param t the tree the subtree belongs to
+ * @param n the subtree to free
+ */
+
+static void art_free(tree t, anode n) {
+    int pos = 0;
+    unsigned char c;
+    anode child;
+
+    if (n->type == ART_LEAF) {
+        t->dealloc(((struct art_leaf *) n)->key);
+    } else {
+        while ((child = art_next_child(n, &pos, &c)) != NULL) {
+            art_free(t, child);
+        }
+    }
+    t->dealloc(n);
+}
+
+/**
+ * Writes a byte of an ART path to a DOT label, as itself if it is a
+ * letter or digit, '$' for the end of a key, or else in hex.
+ * @param c the byte to write
+ * @param out the stream to write the DOT output to.
+ */
+
+static void art_output_byte(unsigned char c, FILE *out) {
+    if (c == '\0') {
+        fputc('$', out);
+    } else if (isalnum(c)) {
+        fputc(c, out);
+    } else {
+        fprintf(out, "%02x", c);
+    }
+}
+
+/**
+ * Writes a DOT description of an ART. Leaves are named after their
+ * keys; inner nodes are numbered after a '#', which no key can hold,
+ * and show their compressed path over a port for each child's byte.
+ * @param n the subtree to output
+ * @param out the stream to write the DOT output to.
+ * @param count the number of inner nodes written so far
+ */
+
+static void art_output_dot(anode n, FILE *out, int *count) {
+    int pos = 0, id, first = 1;
+    unsigned int i;
+    unsigned char c;
+    anode child;
+
+    if (n->type == ART_LEAF) {
+        fprintf(out, "\"%s\"[label=\"%s:%d\"color=black];\n",
+                ((struct art_leaf *) n)->key, ((struct art_leaf *) n)->key,
+                ((struct art_leaf *) n)->freq);
+        return;
+    }
+    id = (*count)++;
+    fprintf(out, "\"#%d\"[label=\"{", id);
+    for (i = 0; i < n->prefix_len && i < ART_MAX_PREFIX; i++) {
+        art_output_byte(n->prefix[i], out);
+    }
+    if (n->prefix_len > ART_MAX_PREFIX) {
+        fprintf(out, "...");
+    }
+    fprintf(out, "|{");
+    while ((child = art_next_child(n, &pos, &c)) != NULL) {
+        fprintf(out, "%s<c%d>", first ? "" : "|", c);
+        art_output_byte(c, out);
+        first = 0;
+    }
+    fprintf(out, "}}\"color=black];\n");
+    pos = 0;
+    while ((child = art_next_child(n, &pos, &c)) != NULL) {
+        if (child->type == ART_LEAF) {
+            art_output_dot(child, out, count);
+            fprintf(out, "\"#%d\":c%d -> \"%s\";\n",
+                    id, c, ((struct art_leaf *) child)->key);
+        } else {
+            fprintf(out, "\"#%d\":c%d -> \"#%d\";\n", id, c, *count);
+            art_output_dot(child, out, count);
+        }
+    }
+}
+
+/**
+ * Collects the keys of a BST or RBT in sorted order.
+ * @param n the subtree to collect from
+ * @param keys the array to put the keys in
+ * @param i the index of the next free place in keys
+ * @return the index of the next free place after the subtree
+ */
+
+static int tree_gather(node n, char **keys, int i) {
+    if (n == NULL) {
+        return i;
+    }
+    i = tree_gather(n->left, keys, i);
+    keys[i++] = n->key;
+    return tree_gather(n->right, keys, i);
+}
+
+/**
+ * Collects the keys of a B-tree in sorted order.
+ * @param b the subtree to collect from
+ * @param keys the array to put the keys in
+ * @param i the index of the next free place in keys
+ * @return the index of the next free place after the subtree
+ */
+
+static int btree_gather(bnode b, char **keys, int i) {
+    int j;
+
+    for (j = 0; j < b->num_keys; j++) {
+        if (b->children[0] != NULL) {
+            i = btree_gather(b->children[j], keys, i);
+        }
+        keys[i++] = b->keys[j];
+    }
+    if (b->children[0] != NULL) {
+        i = btree_gather(b->children[j], keys, i);
+    }
+    return i;
+}
+
+/**
+ * Puts sorted keys into Eytzinger order, where the children of slot k
+ * are slots 2k and 2k + 1, by walking the implicit tree in order.
+ * @param sorted the keys in sorted order
+ * @param order the array to fill, indexed from 1
+ * @param n the number of keys
+ * @param i the index of the next key to place in sorted
+ * @param k the slot to fill the subtree of
+ * @return the index of the next key to place after the subtree
+ */
+
+static int tree_eytzinger(char **sorted, char **order, int n, int i, int k) {
+    if (k <= n) {
+        i = tree_eytzinger(sorted, order, n, i, 2 * k);
+        order[k] = sorted[i++];
+        i = tree_eytzinger(sorted, order, n, i, 2 * k + 1);
+    }
+    return i;
+}
+
+/**
+ * Throws away the snapshot taken by tree_freeze, if there is one.
+ * @param t the tree to thaw
+ */
+
+static void tree_thaw(tree t) {
+    if (t->frozen != NULL) {
+        t->dealloc(t->prefixes);
+        t->dealloc(t->frozen);
+        t->dealloc(t->pool);
+        t->prefixes = NULL;
+        t->frozen = NULL;
+        t->pool = NULL;
+    }
+}
+
+/**
+ * Takes a read-only snapshot of the keys for fast searching. The keys
+ * are laid out as an implicit tree in Eytzinger (breadth first) order,
+ * so the top levels that every search passes through share a few cache
+ * lines, and are copied into one string pool in the same order. Each
+ * slot holds the offset of its key in the pool, and the prefix of the
+ * key in a separate array, so most comparisons never read the pool.
+ * The tree itself is kept, so everything else works as before.
+ * Inserting into the tree throws the snapshot away. An ART is left
+ * as it is, as searching one already reads only the bytes of the
+ * word and was faster than the snapshot.
+ * @param t the tree to freeze
+ */
+
+void tree_freeze(tree t) {
+    char **sorted, **order;
+    size_t pool_size = 0, used = 0, len;
+    int n = t->num_nodes, k;
+
+    tree_thaw(t);
+    if (n == 0 || t->type == ART) {
+        return;
+    }
+    sorted = emalloc(n * sizeof sorted[0]);
+    order = emalloc((n + 1) * sizeof order[0]);
+    if (t->type == BTREE) {
+        btree_gather(t->broot, sorted, 0);
+    } else {
+        tree_gather(t->root, sorted, 0);
+    }
+    tree_eytzinger(sorted, order, n, 0, 1);
+
+    for (k = 1; k <= n; k++) {
+        pool_size += strlen(order[k]) + 1;
+    }
+    t->prefixes = t->alloc((n + 1) * sizeof t->prefixes[0]);
+    t->frozen = t->alloc((n + 1) * sizeof t->frozen[0]);
+    t->pool = t->alloc(pool_size);
+    t->prefixes[0] = 0;
+    t->frozen[0] = 0;
+    for (k = 1; k <= n; k++) {
+        len = strlen(order[k]) + 1;
+        memcpy(t->pool + used, order[k], len);
+        t->prefixes[k] = tree_key_prefix(order[k]);
+        t->frozen[k] = used;
+        used += len;
+    }
+    free(sorted);
+    free(order);
+}
+
+/**
+ * Searches the frozen snapshot of a tree. The walk down the implicit
+ * tree picks the child from the sign of the comparison with no branch,
+ * going right past every key less than str, so it always runs to the
+ * bottom. Shifting off the trailing right turns then gives the first
+ * key not less than str, the only one that can match. Keys are told
+ * apart by their prefixes, with strcmp only for equal prefixes, and
+ * the prefixes a few levels down are prefetched while the comparisons
+ * go on.
+ * @param t the frozen tree to search
+ * @param str the word/string we're searching for.
+ * @return 0 or 1, depending on whether the word is found
+ */
+
+static int tree_search_frozen(tree t, char *str) {
+    uint64_t *prefixes = t->prefixes;
+    uint64_t prefix = tree_key_prefix(str), p;
+    unsigned int n = t->num_nodes, k = 1;
+    size_t ahead;
+
+    while (k <= n) {
+        /* clamped so the pointer stays inside the array */
+        ahead = FROZEN_PREFETCH * k;
+        PREFETCH(prefixes + (ahead < n ? ahead : n));
+        p = prefixes[k];
+        k = 2 * k + (p < prefix || (p == prefix
+                     && strcmp(t->pool + t->frozen[k], str) < 0));
+    }
+    while (k & 1) {
+        k >>= 1;
+    }
+    k >>= 1;
+    return k != 0 && prefixes[k] == prefix
+        && strcmp(t->pool + t->frozen[k], str) == 0;
 }
 
 /**
  * Returns the length of the longest path between the root
  * node and the furthest leaf node.
- * @param t pass in our tree to the function.
+ * @param n pass in our subtree to the function.
  * @return the longest path
  */
 
-int tree_depth(tree t) {
+static int tree_depth_aux(node n) {
     int left_depth, right_depth;
-    if (t == NULL) {
+    if (n == NULL) {
         return -1;
     }
     else {
-        left_depth = tree_depth(t->left);
-        right_depth = tree_depth(t->right);
+        left_depth = tree_depth_aux(n->left);
+        right_depth = tree_depth_aux(n->right);
         if(left_depth > right_depth) {
             return ++left_depth;
         }else{
@@ -73,9 +1279,27 @@ int tree_depth(tree t) {
 }
 
 /**
- * Recursively searches the tree and returns a 0 if the word we're
+ * Returns the length of the longest path between the root
+ * node and the furthest leaf node.
+ * @param t pass in our tree to the function.
+ * @return the longest path, or -1 for an empty tree
+ */
+
+int tree_depth(tree t) {
+    if (t->type == BTREE) {
+        return btree_depth(t->broot);
+    }
+    if (t->type == ART) {
+        return t->aroot == NULL ? -1 : art_depth(t->aroot);
+    }
+    return tree_depth_aux(t->root);
+}
+
+/**
+ * Searches the tree and returns a 0 if the word we're
  * searching for is not in the tree and a 1 if the word
- * we're searching for is in the tree.
+ * we're searching for is in the tree. Each key on the way
+ * down is compared only once.
  * @param t the tree to search
  * @param str the word/string we're searching for.
  * @return 0 or 1, depending on whether the word is found
@@ -83,18 +1307,31 @@ int tree_depth(tree t) {
  */
 
 int tree_search(tree t, char *str) {
-    if (t == NULL) {
-        return 0;
+    uint64_t prefix;
+    node n = t->root;
+    int cmp;
+
+    if (t->frozen != NULL) {
+        return tree_search_frozen(t, str);
     }
-    else if (strcmp(str, t->key) == 0) {
-        return 1;
+    if (t->type == BTREE) {
+        return btree_search(t->broot, str);
     }
-    else if (strcmp(str, t->key) < 0) {
-        return tree_search(t->left, str);
+    if (t->type == ART) {
+        return art_search(t->aroot, str);
     }
-    else {
-        return tree_search(t->right, str);
+    prefix = tree_key_prefix(str);
+    while (n != NULL) {
+        cmp = tree_key_compare(prefix, str, n->prefix, n->key);
+        if (cmp < 0) {
+            n = n->left;
+        } else if (cmp > 0) {
+            n = n->right;
+        } else {
+            return 1;
+        }
     }
+    return 0;
 }
 
 /**
@@ -103,8 +1340,8 @@ int tree_search(tree t, char *str) {
  * @return t return the newly rotated tree
  */
 
-static tree right_rotate(tree t) {
-    tree temp_t = t;
+static node right_rotate(node t) {
+    node temp_t = t;
     t = t->left;
     temp_t->left = t->right;
     t->right = temp_t;
@@ -117,8 +1354,8 @@ static tree right_rotate(tree t) {
  * @return t return the newly rotated tree
  */
 
-static tree left_rotate(tree t) {
-    tree temp_t = t;
+static node left_rotate(node t) {
+    node temp_t = t;
     t = t->right;
     temp_t->right = t->left;
     t->left = temp_t;
@@ -126,13 +1363,14 @@ static tree left_rotate(tree t) {
 }
 
 /**
- * If the tree is an RBT, tree_insert sends the tree
- * to tree_fix to adjust the tree to follow RBT rules
+ * If the tree is an RBT, tree_insert sends the grandparent of
+ * a red node with a red parent to tree_fix to adjust the tree
+ * to follow RBT rules
  * @param t the tree to fix
  * @return t the adjusted/fixed tree
  */
 
-static tree tree_fix(tree t) {
+static node tree_fix(node t) {
     if(IS_RED(t->left) && IS_RED(t->left->left)) {
         if(IS_RED(t->right)) {
             t->colour = RED;
@@ -187,46 +1425,135 @@ static tree tree_fix(tree t) {
 }
 
 /**
- * Allocates memory if the tree is empty and inserts str to
- * the new tree. Inserts str recursively to the rest of the tree.
- * Sends the tree through tree_fix if it's an RBT.
+ * Allocates a new node holding str, coloured red for an RBT.
+ * @param t the tree the node is for
+ * @param str the string to put in the node
+ * @return the new node
+ */
+
+static node tree_new_node(tree t, char *str) {
+    node n = tree_alloc(t, sizeof *n);
+    n->key = tree_copy_key(t, str);
+    n->prefix = tree_key_prefix(str);
+    n->colour = t->type == RBT ? RED : BLACK;
+    n->right = NULL;
+    n->left = NULL;
+    n->freq = 1;
+    t->num_nodes++;
+    return n;
+}
+
+/**
+ * Restores the RBT rules after a red node has been added below
+ * path[depth - 1]. Walks back up the path fixing each red node
+ * with a red parent at its grandparent. A rotation leaves a black
+ * subtree root and a red parent at the root is left alone, so the
+ * walk stops there rather than visiting every node to the root.
+ * @param t the tree that was inserted into
+ * @param path the nodes from the root down to the new node's parent
+ * @param depth the number of nodes in path
+ */
+
+static void tree_fix_up(tree t, node *path, int depth) {
+    node grandparent, fixed, above;
+
+    while (depth >= 2 && IS_RED(path[depth - 1])) {
+        grandparent = path[depth - 2];
+        fixed = tree_fix(grandparent);
+        if (depth == 2) {
+            t->root = fixed;
+        } else {
+            above = path[depth - 3];
+            if (above->left == grandparent) {
+                above->left = fixed;
+            } else {
+                above->right = fixed;
+            }
+        }
+        if (fixed->colour == BLACK) {
+            return;
+        }
+        depth -= 2;
+    }
+}
+
+/**
+ * Inserts str into the tree, or counts it again if it is there
+ * already. Walks down comparing each key once, adds a new node
+ * where the walk falls off the tree, and fixes up an RBT.
  * @param t the tree to be inserted into
  * @param str the string we want to insert into the tree
- * @return the fixed tree
+ * @return the tree
  */
 
 tree tree_insert(tree t, char *str) {
-    if (t == NULL) {
-        t = emalloc(sizeof *t);
-        t->key = emalloc(strlen(str)+1 *sizeof *str);
-        if (tree_type == RBT) {
-            t->colour = RED;
-        }
-        t->right = NULL;
-        t->left = NULL;
-        strcpy(t->key, str);
-        t->freq = 1;
+    node path[RBT_MAX_DEPTH];
+    uint64_t prefix;
+    node n = t->root;
+    int depth = 0;
+    int cmp;
+
+    tree_thaw(t);
+    if (t->type == BTREE) {
+        btree_insert(t, str);
+        return t;
     }
-    
-    else {
-        if (strcmp(t->key, str) == 0) {
-            t->freq++;
+    if (t->type == ART) {
+        art_insert(t, str);
+        return t;
+    }
+    if (n == NULL) {
+        t->root = tree_new_node(t, str);
+        return t;
+    }
+    prefix = tree_key_prefix(str);
+    for (;;) {
+        cmp = tree_key_compare(prefix, str, n->prefix, n->key);
+        if (cmp == 0) {
+            n->freq++;
             return t;
         }
-        else if (strcmp(t->key, str) > 0) {
-            t->left = tree_insert(t->left, str);
+        if (t->type == RBT) {
+            path[depth++] = n;
         }
-        else if (strcmp(t->key, str) < 0) {
-            t->right = tree_insert(t->right, str);
+        if (cmp < 0) {
+            if (n->left == NULL) {
+                n->left = tree_new_node(t, str);
+                break;
+            }
+            n = n->left;
+        } else {
+            if (n->right == NULL) {
+                n->right = tree_new_node(t, str);
+                break;
+            }
+            n = n->right;
         }
     }
-    
-    if(tree_type == RBT) {
-        t = tree_fix(t);
+
+    if (t->type == RBT) {
+        tree_fix_up(t, path, depth);
     }
     return t;
 }
 
+/**
+ * Traverse the subtree through inorder and apply the function
+ * passed into the function to the subtree as we traverse it.
+ * @param n the subtree to traverse through
+ * @param void f() the function we want to use on the tree
+ */
+
+static void tree_inorder_aux(node n, void f(int freq, char *s)) {
+    if (n == NULL) {
+        return;
+    } else {
+        tree_inorder_aux(n->left, f);
+        f(n->freq, n->key);
+        tree_inorder_aux(n->right, f);
+    }
+}
+
 /**
  * Traverse the tree through inorder and apply the function
  * passed into the function to the tree as we traverse it.
@@ -235,50 +1562,101 @@ tree tree_insert(tree t, char *str) {
  */
 
 void tree_inorder(tree t, void f(int freq, char *s)) {
-    if (t == NULL) {
+    if (t->type == BTREE) {
+        if (t->broot != NULL) {
+            btree_inorder(t->broot, f);
+        }
+        return;
+    }
+    if (t->type == ART) {
+        if (t->aroot != NULL) {
+            art_inorder(t->aroot, f);
+        }
+        return;
+    }
+    tree_inorder_aux(t->root, f);
+}
+
+/**
+ * Traverse the subtree through preorder and apply the function
+ * passed into the function to the subtree as we traverse it.
+ * @param n the subtree to traverse through
+ * @param void f() the function we want to use on the tree
+ */
+
+static void tree_preorder_aux(node n, void f(int freq, char *s)) {
+    if (n == NULL) {
         return;
     } else {
-        tree_inorder(t->left, f);
-        f(t->freq, t->key);
-        tree_inorder(t->right, f);
+        f(n->freq, n->key);
+        tree_preorder_aux(n->left, f);
+        tree_preorder_aux(n->right, f);
     }
 }
 
 /**
- * Traverse the tree through inorder and apply the function
+ * Traverse the tree through preorder and apply the function
  * passed into the function to the tree as we traverse it.
+ * An ART keeps its keys only in its leaves, so for an ART this
+ * is the same as inorder.
  * @param t the tree to traverse through
  * @param void f() the function we want to use on the tree
  */
 
 void tree_preorder(tree t, void f(int freq, char *s)) {
-    if (t == NULL) {
+    if (t->type == BTREE) {
+        if (t->broot != NULL) {
+            btree_preorder(t->broot, f);
+        }
+        return;
+    }
+    if (t->type == ART) {
+        if (t->aroot != NULL) {
+            art_inorder(t->aroot, f);
+        }
         return;
-    } else {
-        f(t->freq, t->key);
-        tree_preorder(t->left, f);
-        tree_preorder(t->right, f);
     }
+    tree_preorder_aux(t->root, f);
 }
 
 /**
- * Recursively free the allocated memory to the tree.
- * @param t the tree to free
- * @return t the freed tree
+ * Recursively free the allocated memory to the subtree.
+ * @param t the tree the subtree belongs to
+ * @param n the subtree to free
  */
 
-tree tree_free(tree t) {
+static void tree_free_aux(tree t, node n) {
     
-    if (t == NULL) {
-        return t;
+    if (n == NULL) {
+        return;
     }
 
-    tree_free(t->left);
-    tree_free(t->right);
-    free(t->key);
-    free(t);
+    tree_free_aux(t, n->left);
+    tree_free_aux(t, n->right);
+    t->dealloc(n->key);
+    t->dealloc(n);
+}
 
-    return t;
+/**
+ * Free the allocated memory to the tree.
+ * @param t the tree to free
+ * @return NULL
+ */
+
+tree tree_free(tree t) {
+    tree_thaw(t);
+    if (t->nodes != NULL) {
+        arena_free(t->nodes);
+        arena_free(t->keys);
+    } else if (t->broot != NULL) {
+        btree_free(t, t->broot);
+    } else if (t->aroot != NULL) {
+        art_free(t, t->aroot);
+    } else {
+        tree_free_aux(t, t->root);
+    }
+    free(t);
+    return NULL;
 }
 
 /**
@@ -286,25 +1664,26 @@ tree tree_free(tree t) {
  * possibly colours, to the given output stream.
  *
  * @param t the tree to output a DOT description of.
+ * @param n the subtree to output.
  * @param out the stream to write the DOT output to.
  */
 
-static void tree_output_dot_aux(tree t, FILE *out) {
-    if (t == NULL) {
+static void tree_output_dot_aux(tree t, node n, FILE *out) {
+    if (n == NULL) {
         return;
     }
-    if(t->key != NULL) {
+    if(n->key != NULL) {
         fprintf(out, "\"%s\"[label=\"{<f0>%s:%d|{<f1>|<f2>}}\"color=%s];\n",
-                t->key, t->key, t->freq,
-                (RBT == tree_type && RED == t->colour) ? "red":"black");
+                n->key, n->key, n->freq,
+                (RBT == t->type && RED == n->colour) ? "red":"black");
     }
-    if(t->left != NULL) {
-        tree_output_dot_aux(t->left, out);
-        fprintf(out, "\"%s\":f1 -> \"%s\":f0;\n", t->key, t->left->key);
+    if(n->left != NULL) {
+        tree_output_dot_aux(t, n->left, out);
+        fprintf(out, "\"%s\":f1 -> \"%s\":f0;\n", n->key, n->left->key);
     }
-    if(t->right != NULL) {
-        tree_output_dot_aux(t->right, out);
-        fprintf(out, "\"%s\":f2 -> \"%s\":f0;\n", t->key, t->right->key);
+    if(n->right != NULL) {
+        tree_output_dot_aux(t, n->right, out);
+        fprintf(out, "\"%s\":f2 -> \"%s\":f0;\n", n->key, n->right->key);
     }
 }
 
@@ -324,7 +1703,15 @@ static void tree_output_dot_aux(tree t, FILE *out) {
  */
 
 void tree_output_dot(tree t, FILE *out) {
+    int count = 0;
+
     fprintf(out, "digraph tree {\nnode [shape = Mrecord, penwidth = 2];\n");
-    tree_output_dot_aux(t, out);
+    if (t->broot != NULL) {
+        btree_output_dot(t->broot, out);
+    }
+    if (t->aroot != NULL) {
+        art_output_dot(t->aroot, out, &count);
+    }
+    tree_output_dot_aux(t, t->root, out);
     fprintf(out, "}\n");
 }